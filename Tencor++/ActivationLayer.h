@@ -0,0 +1,154 @@
+#pragma once
+#include "Layer.h"
+#include "Tensor.h"
+#include "Model.h"
+#include <vector>
+#include <cmath>
+
+// Standalone activation, or after fusion a chain of them (e.g. TANH -> RELU) run in a single pass.
+// Only the input is cached: backward recomputes every stage per element, so a chain of n stages
+// keeps one tensor alive instead of n. SOFTMAX is only allowed as the last stage of a chain.
+class ActivationLayer : public Layer {
+public:
+    ActivationLayer(Activation activation) {
+        chain.push_back(activation);
+    }
+
+    Tensor2<double> forward(const Tensor2<double>& input, bool training = false) override {
+        if (!training) {
+            return predict(input);
+        }
+
+        model->forwardStack.push(this);
+        inputCache = input;
+        return predict(input);
+    }
+
+    Tensor2<double> predict(const Tensor2<double>& input) const override {
+        Tensor2<double> output = predictLogits(input);
+        if (chain.back() == SOFTMAX) {
+            return Tensor2<double>::softmax(output, 0);
+        }
+        return output;
+    }
+
+    Tensor2<double> predictLogits(const Tensor2<double>& input) const override {
+        Tensor2<double> output(input.getShape());
+        applyChain(input, output);
+        return output;
+    }
+
+    void predictInto(const Tensor2<double>& input, Tensor2<double>& output) const override {
+        if (output.shape != input.shape) {
+            output = Tensor2<double>(input.shape);
+        }
+        applyChain(input, output);
+        if (chain.back() == SOFTMAX) {
+            applyActivationInPlace(output, SOFTMAX);
+        }
+    }
+
+    Tensor2<double> backward(const Tensor2<double>& dA) override {
+        const int rows = dA.getShape()[0];
+        const int cols = dA.getShape()[1];
+        Tensor2<double> dInput(dA.getShape());
+
+        // Chain rule per element: multiply the stage derivatives while replaying the stages forward.
+        // SOFTMAX contributes 1, matching applyActivationDerivative, as its loss supplies p - y directly.
+        for (int i = 0; i < rows; ++i) {
+            const double* x = inputCache[i].getData();
+            const double* grad = dA[i].getData();
+            double* out = dInput[i].getData();
+            for (int j = 0; j < cols; ++j) {
+                double value = x[j];
+                double derivative = 1.0;
+                for (Activation activation : chain) {
+                    double next = activate(value, activation);
+                    switch (activation) {
+                    case SIGMOID:
+                        derivative *= next * (1.0 - next);
+                        break;
+                    case RELU:
+                        derivative *= value > 0 ? 1.0 : 0.0;
+                        break;
+                    case TANH:
+                        derivative *= 1.0 - next * next;
+                        break;
+                    default:
+                        break;
+                    }
+                    value = next;
+                }
+                out[j] = grad[j] * derivative;
+            }
+        }
+
+        return dInput;
+    }
+
+    const std::vector<Activation>& getActivations() const {
+        return chain;
+    }
+
+    // Appends the other layer's stages to this chain; fails if this chain already ends in SOFTMAX
+    bool absorb(const ActivationLayer& other) {
+        if (chain.back() == SOFTMAX) {
+            return false;
+        }
+        chain.insert(chain.end(), other.chain.begin(), other.chain.end());
+        return true;
+    }
+
+    // The input
+    size_t trainingCacheBytes(int inputWidth, int batchSize) const override {
+        return sizeof(double) * inputWidth * static_cast<size_t>(batchSize);
+    }
+
+    // A trailing softmax builds its result from a copy of the chain's output
+    size_t trainingWorkspaceBytes(int inputWidth, int batchSize, bool backward) const override {
+        return !backward && chain.back() == SOFTMAX ? sizeof(double) * inputWidth * static_cast<size_t>(batchSize) : 0;
+    }
+
+    void releaseCache() override {
+        inputCache = Tensor2<double>();
+    }
+
+    Layer* clone() const override {
+        return new ActivationLayer(*this);
+    }
+
+private:
+    std::vector<Activation> chain;
+    Tensor2<double> inputCache;
+
+    // SOFTMAX is applied across the whole column afterwards, so it is the identity here
+    static double activate(double x, Activation activation) {
+        switch (activation) {
+        case SIGMOID:
+            return 1.0 / (1.0 + exp(-x));
+        case RELU:
+            return x > 0 ? x : 0.0;
+        case TANH:
+            return tanh(x);
+        default:
+            return x;
+        }
+    }
+
+    // Runs every stage per element, softmax excepted; output already has input's shape
+    void applyChain(const Tensor2<double>& input, Tensor2<double>& output) const {
+        const int rows = input.shape[0];
+        const int cols = input.shape[1];
+        for (int i = 0; i < rows; ++i) {
+            const double* x = input[i].getData();
+            double* out = output[i].getData();
+            for (int j = 0; j < cols; ++j) {
+                double value = x[j];
+                for (Activation activation : chain) {
+                    value = activate(value, activation);
+                }
+                out[j] = value;
+            }
+        }
+    }
+};
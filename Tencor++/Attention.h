@@ -0,0 +1,332 @@
+#pragma once
+#include "Layer.h"
+#include "Tensor.h"
+#include "Model.h"
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+// Multi-head self-attention over (seqLen * modelDim) x batch inputs, token-major (what Embedding produces).
+// Projections are batched GEMMs (Tensor3::dot) against shared (1, K, N) weights. Attention itself is
+// tiled with an online softmax, so only a blockSize x blockSize score tile exists at any time and
+// memory stays O(seqLen) per head: the forward keeps just one log-sum-exp per query for backward.
+class MultiHeadAttention : public Layer {
+public:
+    MultiHeadAttention(int seqLen, int modelDim, int numHeads, bool causal = false, int blockSize = 64)
+        : seqLen(seqLen), modelDim(modelDim), numHeads(numHeads), causal(causal), blockSize(blockSize),
+          qkvWeights({ 1, modelDim, 3 * modelDim }, InitType::Random),
+          outputWeights({ 1, modelDim, modelDim }, InitType::Random),
+          dQkvWeights({ modelDim, 3 * modelDim }), dOutputWeights({ modelDim, modelDim }) {
+        if (numHeads <= 0 || modelDim % numHeads != 0) {
+            std::cerr << "modelDim must be divisible by numHeads" << std::endl;
+            throw std::invalid_argument("modelDim must be divisible by numHeads");
+        }
+        if (blockSize <= 0) {
+            std::cerr << "Block size must be greater than 0" << std::endl;
+            throw std::invalid_argument("Block size must be greater than 0");
+        }
+        headDim = modelDim / numHeads;
+        cache = nullptr;
+    }
+
+    ~MultiHeadAttention() {
+        delete cache;
+    }
+
+    Tensor2<double> forward(const Tensor2<double>& input, bool training = false) override {
+        if (!training) {
+            return predict(input);
+        }
+
+        model->forwardStack.push(this);
+        Tensor3<double> x = toSequences(input, seqLen * modelDim);
+        Tensor3<double> qkv = Tensor3<double>::dot(x, qkvWeights);
+        Tensor3<double> attended({ x.getShape()[0], seqLen, modelDim });
+        std::vector<double> logSumExp(static_cast<size_t>(x.getShape()[0]) * numHeads * seqLen);
+        attend(qkv, attended, logSumExp.data());
+        Tensor2<double> output = fromSequences(Tensor3<double>::dot(attended, outputWeights));
+
+        if (cache != nullptr) {
+            delete cache;
+            cache = nullptr;
+        }
+        cache = new Cache{ std::move(x), std::move(qkv), std::move(attended), std::move(logSumExp) };
+
+        return output;
+    }
+
+    Tensor2<double> predict(const Tensor2<double>& input) const override {
+        Tensor3<double> qkv = Tensor3<double>::dot(toSequences(input, seqLen * modelDim), qkvWeights);
+        Tensor3<double> attended({ qkv.getShape()[0], seqLen, modelDim });
+        attend(qkv, attended, nullptr);
+        return fromSequences(Tensor3<double>::dot(attended, outputWeights));
+    }
+
+    Tensor2<double> backward(const Tensor2<double>& dA) override {
+        const int batch = cache->input.getShape()[0];
+        Tensor3<double> dOutput = toSequences(dA, seqLen * modelDim);
+
+        for (int b = 0; b < batch; ++b) {
+            Tensor2<double>::dotInto(cache->attended[b], dOutput[b], dOutputWeights, true, false, true);
+        }
+        Tensor3<double> dAttended = Tensor3<double>::dot(dOutput, outputWeights, false, true);
+
+        Tensor3<double> dQkv({ batch, seqLen, 3 * modelDim });
+        attendBackward(cache->qkv, cache->attended, dAttended, cache->logSumExp.data(), dQkv);
+
+        for (int b = 0; b < batch; ++b) {
+            Tensor2<double>::dotInto(cache->input[b], dQkv[b], dQkvWeights, true, false, true);
+        }
+        return fromSequences(Tensor3<double>::dot(dQkv, qkvWeights, false, true));
+    }
+
+    std::vector<Parameter> parameters() override {
+        return { { &qkvWeights[0], &dQkvWeights }, { &outputWeights[0], &dOutputWeights } };
+    }
+
+    // Columns [0, d) project queries, [d, 2d) keys and [2d, 3d) values; head h owns a headDim-wide slice of each
+    Tensor2<double>& getQkvWeights() {
+        return qkvWeights[0];
+    }
+
+    Tensor2<double>& getOutputWeights() {
+        return outputWeights[0];
+    }
+
+    int getOutputSize() const override {
+        return seqLen * modelDim;
+    }
+
+    struct Cache {
+        Tensor3<double> input;
+        Tensor3<double> qkv;
+        Tensor3<double> attended;
+        std::vector<double> logSumExp;
+    };
+
+    // The input, the projections, the attended values and one log-sum-exp per query and head
+    size_t trainingCacheBytes(int /*inputWidth*/, int batchSize) const override {
+        const size_t tokens = static_cast<size_t>(batchSize) * seqLen;
+        return sizeof(double) * (tokens * modelDim + tokens * 3 * modelDim + tokens * modelDim + tokens * numHeads);
+    }
+
+    // Forward: the projected output and one score tile; backward: the output, attended and projection
+    // gradients, the input gradient and the per-query dot products
+    size_t trainingWorkspaceBytes(int /*inputWidth*/, int batchSize, bool backward) const override {
+        const size_t tokens = static_cast<size_t>(batchSize) * seqLen;
+        if (backward) {
+            return sizeof(double) * (3 * tokens * modelDim + tokens * 3 * modelDim + seqLen);
+        }
+        const size_t tile = static_cast<size_t>(blockSize) * blockSize + 2 * blockSize + static_cast<size_t>(blockSize) * headDim;
+        return sizeof(double) * (tokens * modelDim + tile);
+    }
+
+    void releaseCache() override {
+        delete cache;
+        cache = nullptr;
+    }
+
+    Layer* clone() const override {
+        MultiHeadAttention* copy = new MultiHeadAttention(*this);
+        copy->cache = nullptr;
+        return copy;
+    }
+
+private:
+    int seqLen;
+    int modelDim;
+    int numHeads;
+    int headDim;
+    bool causal;
+    int blockSize;
+    Tensor3<double> qkvWeights;
+    Tensor3<double> outputWeights;
+    Tensor2<double> dQkvWeights;
+    Tensor2<double> dOutputWeights;
+    Cache* cache;
+
+    // (seqLen * width) x batch -> (batch, seqLen, width)
+    Tensor3<double> toSequences(const Tensor2<double>& input, int rows) const {
+        if (input.getShape()[0] != rows) {
+            std::cerr << "Attention input must have seqLen * modelDim rows" << std::endl;
+            throw std::invalid_argument("Attention input must have seqLen * modelDim rows");
+        }
+        const int batch = input.getShape()[1];
+        const int width = rows / seqLen;
+        Tensor3<double> result({ batch, seqLen, width });
+        for (int s = 0; s < seqLen; ++s) {
+            for (int d = 0; d < width; ++d) {
+                const double* src = input[s * width + d].getData();
+                for (int b = 0; b < batch; ++b) {
+                    result[b][s][d] = src[b];
+                }
+            }
+        }
+        return result;
+    }
+
+    Tensor2<double> fromSequences(const Tensor3<double>& sequences) const {
+        const int batch = sequences.getShape()[0];
+        const int width = sequences.getShape()[2];
+        Tensor2<double> result({ seqLen * width, batch });
+        for (int b = 0; b < batch; ++b) {
+            for (int s = 0; s < seqLen; ++s) {
+                const double* src = sequences[b][s].getData();
+                for (int d = 0; d < width; ++d) {
+                    result[s * width + d][b] = src[d];
+                }
+            }
+        }
+        return result;
+    }
+
+    // Online-softmax attention, one query block at a time against every key block
+    void attend(const Tensor3<double>& qkv, Tensor3<double>& attended, double* logSumExp) const {
+        const int batch = qkv.getShape()[0];
+        const double scale = 1.0 / std::sqrt(static_cast<double>(headDim));
+        const double negInf = -std::numeric_limits<double>::infinity();
+        std::vector<double> scores(static_cast<size_t>(blockSize) * blockSize);
+        std::vector<double> rowMax(blockSize);
+        std::vector<double> rowSum(blockSize);
+        std::vector<double> accumulator(static_cast<size_t>(blockSize) * headDim);
+
+        for (int b = 0; b < batch; ++b) {
+            const Tensor2<double>& projections = qkv[b];
+            for (int h = 0; h < numHeads; ++h) {
+                const int qOffset = h * headDim;
+                const int kOffset = modelDim + h * headDim;
+                const int vOffset = 2 * modelDim + h * headDim;
+
+                for (int i0 = 0; i0 < seqLen; i0 += blockSize) {
+                    const int queries = std::min(blockSize, seqLen - i0);
+                    const int keyEnd = causal ? i0 + queries : seqLen;
+                    std::fill(rowMax.begin(), rowMax.end(), negInf);
+                    std::fill(rowSum.begin(), rowSum.end(), 0.0);
+                    std::fill(accumulator.begin(), accumulator.end(), 0.0);
+
+                    for (int j0 = 0; j0 < keyEnd; j0 += blockSize) {
+                        const int keys = std::min(blockSize, keyEnd - j0);
+
+                        for (int ii = 0; ii < queries; ++ii) {
+                            const double* q = projections[i0 + ii].getData() + qOffset;
+                            double* tile = scores.data() + static_cast<size_t>(ii) * blockSize;
+                            double tileMax = negInf;
+                            for (int jj = 0; jj < keys; ++jj) {
+                                if (causal && j0 + jj > i0 + ii) {
+                                    tile[jj] = negInf;
+                                    continue;
+                                }
+                                const double* k = projections[j0 + jj].getData() + kOffset;
+                                double s = 0.0;
+                                for (int d = 0; d < headDim; ++d) {
+                                    s += q[d] * k[d];
+                                }
+                                tile[jj] = s * scale;
+                                tileMax = tile[jj] > tileMax ? tile[jj] : tileMax;
+                            }
+
+                            // Rescale what has been accumulated so far to the new running max
+                            const double newMax = tileMax > rowMax[ii] ? tileMax : rowMax[ii];
+                            const double correction = std::exp(rowMax[ii] - newMax);
+                            double* acc = accumulator.data() + static_cast<size_t>(ii) * headDim;
+                            rowSum[ii] *= correction;
+                            for (int d = 0; d < headDim; ++d) {
+                                acc[d] *= correction;
+                            }
+
+                            for (int jj = 0; jj < keys; ++jj) {
+                                const double p = std::exp(tile[jj] - newMax);
+                                if (p == 0.0) {
+                                    continue;
+                                }
+                                const double* v = projections[j0 + jj].getData() + vOffset;
+                                rowSum[ii] += p;
+                                for (int d = 0; d < headDim; ++d) {
+                                    acc[d] += p * v[d];
+                                }
+                            }
+                            rowMax[ii] = newMax;
+                        }
+                    }
+
+                    for (int ii = 0; ii < queries; ++ii) {
+                        double* out = attended[b][i0 + ii].getData() + qOffset;
+                        const double* acc = accumulator.data() + static_cast<size_t>(ii) * headDim;
+                        for (int d = 0; d < headDim; ++d) {
+                            out[d] = acc[d] / rowSum[ii];
+                        }
+                        if (logSumExp != nullptr) {
+                            logSumExp[(static_cast<size_t>(b) * numHeads + h) * seqLen + i0 + ii] = rowMax[ii] + std::log(rowSum[ii]);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Recomputes each probability from the saved log-sum-exp instead of storing the attention matrix
+    void attendBackward(const Tensor3<double>& qkv, const Tensor3<double>& attended, const Tensor3<double>& dAttended,
+                        const double* logSumExp, Tensor3<double>& dQkv) const {
+        const int batch = qkv.getShape()[0];
+        const double scale = 1.0 / std::sqrt(static_cast<double>(headDim));
+        std::vector<double> rowDot(seqLen);
+
+        for (int b = 0; b < batch; ++b) {
+            const Tensor2<double>& projections = qkv[b];
+            Tensor2<double>& grads = dQkv[b];
+            for (int h = 0; h < numHeads; ++h) {
+                const int qOffset = h * headDim;
+                const int kOffset = modelDim + h * headDim;
+                const int vOffset = 2 * modelDim + h * headDim;
+                const double* lse = logSumExp + (static_cast<size_t>(b) * numHeads + h) * seqLen;
+
+                // D_i = dO_i . O_i, the softmax Jacobian term shared by a whole query row
+                for (int i = 0; i < seqLen; ++i) {
+                    const double* o = attended[b][i].getData() + qOffset;
+                    const double* dO = dAttended[b][i].getData() + qOffset;
+                    double sum = 0.0;
+                    for (int d = 0; d < headDim; ++d) {
+                        sum += o[d] * dO[d];
+                    }
+                    rowDot[i] = sum;
+                }
+
+                for (int j0 = 0; j0 < seqLen; j0 += blockSize) {
+                    const int keyEnd = std::min(j0 + blockSize, seqLen);
+                    for (int i0 = causal ? j0 : 0; i0 < seqLen; i0 += blockSize) {
+                        const int queryEnd = std::min(i0 + blockSize, seqLen);
+                        for (int i = i0; i < queryEnd; ++i) {
+                            const double* q = projections[i].getData() + qOffset;
+                            const double* dO = dAttended[b][i].getData() + qOffset;
+                            double* dq = grads[i].getData() + qOffset;
+                            for (int j = j0; j < keyEnd; ++j) {
+                                if (causal && j > i) {
+                                    break;
+                                }
+                                const double* k = projections[j].getData() + kOffset;
+                                const double* v = projections[j].getData() + vOffset;
+                                double* dk = grads[j].getData() + kOffset;
+                                double* dv = grads[j].getData() + vOffset;
+
+                                double s = 0.0;
+                                double dp = 0.0;
+                                for (int d = 0; d < headDim; ++d) {
+                                    s += q[d] * k[d];
+                                    dp += dO[d] * v[d];
+                                }
+                                const double p = std::exp(s * scale - lse[i]);
+                                const double ds = p * (dp - rowDot[i]) * scale;
+                                for (int d = 0; d < headDim; ++d) {
+                                    dv[d] += p * dO[d];
+                                    dq[d] += ds * k[d];
+                                    dk[d] += ds * q[d];
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+};
@@ -0,0 +1,485 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+#include "Tensor.h"
+
+// LIFO record of the layers a training forward ran, replayed backwards by Model::backpropagate.
+// Backed by a vector that keeps its capacity, so once warmed up a step pushes and pops without
+// allocating (the linked-list Stack allocated a node per push).
+template <typename T>
+class Tape {
+public:
+    void push(T entry) {
+        entries.push_back(entry);
+    }
+
+    T pop() {
+        if (entries.empty()) {
+            throw std::runtime_error("Tape underflow: Cannot pop from an empty tape");
+        }
+        T entry = entries.back();
+        entries.pop_back();
+        return entry;
+    }
+
+    T peek() const {
+        if (entries.empty()) {
+            throw std::runtime_error("Tape underflow: Cannot peek at an empty tape");
+        }
+        return entries.back();
+    }
+
+    bool isEmpty() const {
+        return entries.empty();
+    }
+
+    int getSize() const {
+        return static_cast<int>(entries.size());
+    }
+
+    void clear() {
+        entries.clear();
+    }
+
+private:
+    std::vector<T> entries;
+};
+
+// Reverse-mode automatic differentiation over Tensor2 ops. Every op appends a node to an arena of
+// nodes that reset() rewinds without freeing: each node keeps its value and gradient tensors, so a
+// graph recorded with the same shapes step after step allocates nothing after the first step.
+// Nodes are recorded in topological order, so backward is a single reverse sweep; a value used
+// twice (a residual connection, a shared weight) simply receives the sum of both gradients.
+class Graph {
+public:
+    struct Var {
+        int id;
+    };
+
+    // Copies value into the graph; requiresGrad makes gradient() available for it after backward
+    Var input(const Tensor2<double>& value, bool requiresGrad = false) {
+        Var var = record(INPUT, -1, -1);
+        Node& node = nodes[var.id];
+        node.requiresGrad = requiresGrad;
+        ensureShape(node.value, value.shape[0], value.shape[1]);
+        for (int i = 0; i < value.shape[0]; ++i) {
+            std::copy(value[i].getData(), value[i].getData() + value.shape[1], node.value[i].getData());
+        }
+        return var;
+    }
+
+    // Read in place, not copied; backward adds its gradient into grad. Without grad it is a constant.
+    Var parameter(const Tensor2<double>& value, Tensor2<double>* grad = nullptr) {
+        Var var = record(PARAMETER, -1, -1);
+        Node& node = nodes[var.id];
+        node.external = &value;
+        node.externalGrad = grad;
+        node.requiresGrad = grad != nullptr;
+        return var;
+    }
+
+    // op(a) . op(b)
+    Var matmul(Var a, Var b, bool transposeA = false, bool transposeB = false) {
+        Var var = record(MATMUL, a.id, b.id);
+        Node& node = nodes[var.id];
+        node.transposeA = transposeA;
+        node.transposeB = transposeB;
+        const Tensor2<double>& x = value(a);
+        const Tensor2<double>& y = value(b);
+        ensureShape(node.value, transposeA ? x.shape[1] : x.shape[0], transposeB ? y.shape[0] : y.shape[1]);
+        Tensor2<double>::dotInto(x, y, node.value, transposeA, transposeB);
+        return var;
+    }
+
+    // a + b; a b with a single column is added to every column of a (a bias)
+    Var add(Var a, Var b) {
+        const bool broadcast = value(b).shape[1] == 1 && value(a).shape[1] != 1;
+        Var var = record(broadcast ? ADD_COLUMN : ADD, a.id, b.id);
+        elementwise(var, [](double x, double y) { return x + y; });
+        return var;
+    }
+
+    Var subtract(Var a, Var b) {
+        Var var = record(SUBTRACT, a.id, b.id);
+        elementwise(var, [](double x, double y) { return x - y; });
+        return var;
+    }
+
+    // Elementwise product
+    Var multiply(Var a, Var b) {
+        Var var = record(MULTIPLY, a.id, b.id);
+        elementwise(var, [](double x, double y) { return x * y; });
+        return var;
+    }
+
+    Var scale(Var a, double factor) {
+        Var var = record(SCALE, a.id, -1);
+        nodes[var.id].scalar = factor;
+        unary(var, [factor](double x) { return x * factor; });
+        return var;
+    }
+
+    Var relu(Var a) {
+        Var var = record(RELU_OP, a.id, -1);
+        unary(var, [](double x) { return x > 0 ? x : 0.0; });
+        return var;
+    }
+
+    Var sigmoid(Var a) {
+        Var var = record(SIGMOID_OP, a.id, -1);
+        unary(var, [](double x) { return 1.0 / (1.0 + std::exp(-x)); });
+        return var;
+    }
+
+    Var tanh(Var a) {
+        Var var = record(TANH_OP, a.id, -1);
+        unary(var, [](double x) { return std::tanh(x); });
+        return var;
+    }
+
+    // Per column, like the SOFTMAX activation
+    Var softmax(Var a) {
+        Var var = record(SOFTMAX_OP, a.id, -1);
+        Node& node = nodes[var.id];
+        const Tensor2<double>& x = value(a);
+        const int rows = x.shape[0];
+        const int cols = x.shape[1];
+        ensureShape(node.value, rows, cols);
+        columns.resize(2 * static_cast<size_t>(cols));
+        double* maximum = columns.data();
+        double* total = maximum + cols;
+        std::copy(x[0].getData(), x[0].getData() + cols, maximum);
+        std::fill(total, total + cols, 0.0);
+        for (int i = 1; i < rows; ++i) {
+            const double* row = x[i].getData();
+            for (int j = 0; j < cols; ++j) {
+                maximum[j] = std::max(maximum[j], row[j]);
+            }
+        }
+        for (int i = 0; i < rows; ++i) {
+            const double* row = x[i].getData();
+            double* out = node.value[i].getData();
+            for (int j = 0; j < cols; ++j) {
+                out[j] = std::exp(row[j] - maximum[j]);
+                total[j] += out[j];
+            }
+        }
+        for (int i = 0; i < rows; ++i) {
+            double* out = node.value[i].getData();
+            for (int j = 0; j < cols; ++j) {
+                out[j] /= total[j];
+            }
+        }
+        return var;
+    }
+
+    const Tensor2<double>& value(Var var) const {
+        const Node& node = nodes[var.id];
+        return node.external != nullptr ? *node.external : node.value;
+    }
+
+    // Gradient of an input recorded with requiresGrad, after backward
+    const Tensor2<double>& gradient(Var var) {
+        Node& node = nodes[var.id];
+        if (!node.hasGrad) {
+            ensureShape(node.grad, value(var).shape[0], value(var).shape[1]);
+            zero(node.grad);
+            node.hasGrad = true;
+        }
+        return node.grad;
+    }
+
+    // Propagates seed (d loss / d output) to every node output depends on
+    void backward(Var output, const Tensor2<double>& seed) {
+        for (int id = 0; id <= output.id; ++id) {
+            nodes[id].hasGrad = false;
+        }
+        Node& out = nodes[output.id];
+        ensureShape(out.grad, seed.shape[0], seed.shape[1]);
+        for (int i = 0; i < seed.shape[0]; ++i) {
+            std::copy(seed[i].getData(), seed[i].getData() + seed.shape[1], out.grad[i].getData());
+        }
+        out.hasGrad = true;
+
+        for (int id = output.id; id >= 0; --id) {
+            if (nodes[id].hasGrad && nodes[id].requiresGrad) {
+                propagate(id);
+            }
+        }
+    }
+
+    // Rewinds the arena for the next step, keeping every node's storage
+    void reset() {
+        count = 0;
+    }
+
+    // Rewinds and frees the storage as well
+    void clear() {
+        nodes.clear();
+        columns = std::vector<double>();
+        count = 0;
+    }
+
+    // Storage the arena holds, including nodes past the current step that reset() kept
+    size_t bytes() const {
+        size_t total = 0;
+        for (const Node& node : nodes) {
+            for (const Tensor2<double>* tensor : { &node.value, &node.grad }) {
+                if (tensor->shape.size() == 2) {
+                    total += sizeof(double) * tensor->shape[0] * static_cast<size_t>(tensor->shape[1]);
+                }
+            }
+        }
+        return total + sizeof(double) * columns.capacity();
+    }
+
+private:
+    enum Op {
+        INPUT,
+        PARAMETER,
+        MATMUL,
+        ADD,
+        ADD_COLUMN,
+        SUBTRACT,
+        MULTIPLY,
+        SCALE,
+        RELU_OP,
+        SIGMOID_OP,
+        TANH_OP,
+        SOFTMAX_OP
+    };
+
+    struct Node {
+        Op op = INPUT;
+        int a = -1;
+        int b = -1;
+        double scalar = 0.0;
+        bool transposeA = false;
+        bool transposeB = false;
+        bool requiresGrad = false;
+        bool hasGrad = false;
+        const Tensor2<double>* external = nullptr;
+        Tensor2<double>* externalGrad = nullptr;
+        Tensor2<double> value;
+        Tensor2<double> grad;
+    };
+
+    std::vector<Node> nodes;
+    int count = 0;
+    // Per-column scratch for softmax and its backward, grown to the widest batch and kept like the nodes
+    std::vector<double> columns;
+
+    Var record(Op op, int a, int b) {
+        if (count == static_cast<int>(nodes.size())) {
+            nodes.emplace_back();
+        }
+        Node& node = nodes[count];
+        node.op = op;
+        node.a = a;
+        node.b = b;
+        node.transposeA = false;
+        node.transposeB = false;
+        node.hasGrad = false;
+        node.external = nullptr;
+        node.externalGrad = nullptr;
+        node.requiresGrad = (a >= 0 && nodes[a].requiresGrad) || (b >= 0 && nodes[b].requiresGrad);
+        return { count++ };
+    }
+
+    // Reuses t's storage when the shape already matches
+    static void ensureShape(Tensor2<double>& t, int rows, int cols) {
+        if (t.shape.size() != 2 || t.shape[0] != rows || t.shape[1] != cols) {
+            t = Tensor2<double>({ rows, cols });
+        }
+    }
+
+    static void zero(Tensor2<double>& t) {
+        const int cols = t.shape[1];
+        for (int i = 0; i < t.shape[0]; ++i) {
+            std::fill(t[i].getData(), t[i].getData() + cols, 0.0);
+        }
+    }
+
+    template <typename F>
+    void unary(Var var, F f) {
+        Node& node = nodes[var.id];
+        const Tensor2<double>& x = value({ node.a });
+        const int rows = x.shape[0];
+        const int cols = x.shape[1];
+        ensureShape(node.value, rows, cols);
+        for (int i = 0; i < rows; ++i) {
+            const double* in = x[i].getData();
+            double* out = node.value[i].getData();
+            for (int j = 0; j < cols; ++j) {
+                out[j] = f(in[j]);
+            }
+        }
+    }
+
+    template <typename F>
+    void elementwise(Var var, F f) {
+        Node& node = nodes[var.id];
+        const Tensor2<double>& x = value({ node.a });
+        const Tensor2<double>& y = value({ node.b });
+        const bool broadcast = node.op == ADD_COLUMN;
+        if (!broadcast && (x.shape[0] != y.shape[0] || x.shape[1] != y.shape[1])) {
+            throw std::invalid_argument("Graph operands must have the same shape");
+        }
+        const int rows = x.shape[0];
+        const int cols = x.shape[1];
+        ensureShape(node.value, rows, cols);
+        for (int i = 0; i < rows; ++i) {
+            const double* left = x[i].getData();
+            const double* right = y[i].getData();
+            double* out = node.value[i].getData();
+            for (int j = 0; j < cols; ++j) {
+                out[j] = f(left[j], broadcast ? right[0] : right[j]);
+            }
+        }
+    }
+
+    // Gradient buffer of node id to write into. fresh means it holds nothing yet and must be
+    // overwritten rather than added to; parameters always add into their external gradient.
+    Tensor2<double>& target(int id, bool& fresh) {
+        Node& node = nodes[id];
+        if (node.op == PARAMETER) {
+            fresh = false;
+            return *node.externalGrad;
+        }
+        fresh = !node.hasGrad;
+        if (fresh) {
+            ensureShape(node.grad, value({ id }).shape[0], value({ id }).shape[1]);
+        }
+        node.hasGrad = true;
+        return node.grad;
+    }
+
+    // dst (+)= f(i, j) over dst's elements
+    template <typename F>
+    void write(int id, F f) {
+        bool fresh;
+        Tensor2<double>& dst = target(id, fresh);
+        const int rows = dst.shape[0];
+        const int cols = dst.shape[1];
+        for (int i = 0; i < rows; ++i) {
+            double* d = dst[i].getData();
+            for (int j = 0; j < cols; ++j) {
+                d[j] = fresh ? f(i, j) : d[j] + f(i, j);
+            }
+        }
+    }
+
+    void propagate(int id) {
+        Node& node = nodes[id];
+        const Tensor2<double>& g = node.grad;
+        const int a = node.a;
+        const int b = node.b;
+        const bool needA = a >= 0 && nodes[a].requiresGrad;
+        const bool needB = b >= 0 && nodes[b].requiresGrad;
+
+        switch (node.op) {
+        case MATMUL: {
+            const Tensor2<double>& x = value({ a });
+            const Tensor2<double>& y = value({ b });
+            bool fresh;
+            if (needA) {
+                Tensor2<double>& dA = target(a, fresh);
+                if (node.transposeA) {
+                    Tensor2<double>::dotInto(y, g, dA, node.transposeB, true, !fresh);
+                }
+                else {
+                    Tensor2<double>::dotInto(g, y, dA, false, !node.transposeB, !fresh);
+                }
+            }
+            if (needB) {
+                Tensor2<double>& dB = target(b, fresh);
+                if (node.transposeB) {
+                    Tensor2<double>::dotInto(g, x, dB, true, node.transposeA, !fresh);
+                }
+                else {
+                    Tensor2<double>::dotInto(x, g, dB, !node.transposeA, false, !fresh);
+                }
+            }
+            break;
+        }
+        case ADD:
+        case SUBTRACT: {
+            const double sign = node.op == SUBTRACT ? -1.0 : 1.0;
+            if (needA) {
+                write(a, [&](int i, int j) { return g[i][j]; });
+            }
+            if (needB) {
+                write(b, [&](int i, int j) { return sign * g[i][j]; });
+            }
+            break;
+        }
+        case ADD_COLUMN: {
+            if (needA) {
+                write(a, [&](int i, int j) { return g[i][j]; });
+            }
+            if (needB) {
+                const int cols = g.shape[1];
+                write(b, [&](int i, int) {
+                    const double* row = g[i].getData();
+                    double sum = 0.0;
+                    for (int j = 0; j < cols; ++j) {
+                        sum += row[j];
+                    }
+                    return sum;
+                });
+            }
+            break;
+        }
+        case MULTIPLY: {
+            const Tensor2<double>& x = value({ a });
+            const Tensor2<double>& y = value({ b });
+            if (needA) {
+                write(a, [&](int i, int j) { return g[i][j] * y[i][j]; });
+            }
+            if (needB) {
+                write(b, [&](int i, int j) { return g[i][j] * x[i][j]; });
+            }
+            break;
+        }
+        case SCALE: {
+            const double factor = node.scalar;
+            write(a, [&](int i, int j) { return g[i][j] * factor; });
+            break;
+        }
+        case RELU_OP: {
+            const Tensor2<double>& x = value({ a });
+            write(a, [&](int i, int j) { return x[i][j] > 0 ? g[i][j] : 0.0; });
+            break;
+        }
+        case SIGMOID_OP: {
+            const Tensor2<double>& s = node.value;
+            write(a, [&](int i, int j) { return g[i][j] * s[i][j] * (1.0 - s[i][j]); });
+            break;
+        }
+        case TANH_OP: {
+            const Tensor2<double>& t = node.value;
+            write(a, [&](int i, int j) { return g[i][j] * (1.0 - t[i][j] * t[i][j]); });
+            break;
+        }
+        case SOFTMAX_OP: {
+            // dx = s * (g - sum over the column of g * s)
+            const Tensor2<double>& s = node.value;
+            const int rows = s.shape[0];
+            const int cols = s.shape[1];
+            columns.assign(cols, 0.0);
+            double* dotted = columns.data();
+            for (int i = 0; i < rows; ++i) {
+                for (int j = 0; j < cols; ++j) {
+                    dotted[j] += g[i][j] * s[i][j];
+                }
+            }
+            write(a, [&](int i, int j) { return s[i][j] * (g[i][j] - dotted[j]); });
+            break;
+        }
+        default:
+            break;
+        }
+    }
+};
@@ -0,0 +1,211 @@
+#pragma once
+#include "Layer.h"
+#include "Tensor.h"
+#include "Model.h"
+#include <vector>
+#include <cmath>
+
+// Normalizes every feature row over the batch, then applies a learned scale (gamma) and shift (beta).
+// The activation runs after normalization, so Dense(LINEAR) -> BatchNorm(act) can later be folded
+// into a single Dense(act) for inference with Sequential::foldBatchNorm or fuseLayers(true).
+class BatchNorm : public Layer {
+public:
+    BatchNorm(int features, Activation activation = LINEAR, double momentum = 0.9, double epsilon = 1e-5)
+        : features(features), activation(activation), momentum(momentum), epsilon(epsilon) {
+        gamma = Tensor2<double>({ features, 1 }, InitType::Ones);
+        beta = Tensor2<double>({ features, 1 });
+        runningMean = Tensor2<double>({ features, 1 });
+        runningVar = Tensor2<double>({ features, 1 }, InitType::Ones);
+        dGamma = Tensor2<double>({ features, 1 });
+        dBeta = Tensor2<double>({ features, 1 });
+    }
+
+    Tensor2<double> forward(const Tensor2<double>& input, bool training = false) override {
+        if (!training) {
+            return predict(input);
+        }
+        checkInput(input);
+
+        model->forwardStack.push(this);
+        const int batch = input.getShape()[1];
+        normalized = Tensor2<double>(input.getShape());
+        activationCache = Tensor2<double>(input.getShape());
+        invStd.assign(features, 0.0);
+
+        for (int i = 0; i < features; ++i) {
+            const double* x = input[i].getData();
+
+            // One pass for mean and variance. Sums are taken around the first sample so large
+            // offsets do not cancel catastrophically, and the loop stays free of dependencies.
+            const double shift = x[0];
+            double sum = 0.0;
+            double sumSquares = 0.0;
+            for (int b = 0; b < batch; ++b) {
+                double d = x[b] - shift;
+                sum += d;
+                sumSquares += d * d;
+            }
+            double meanShifted = sum / batch;
+            double mean = shift + meanShifted;
+            double variance = sumSquares / batch - meanShifted * meanShifted;
+            variance = variance > 0.0 ? variance : 0.0;
+
+            invStd[i] = 1.0 / std::sqrt(variance + epsilon);
+            runningMean[i][0] = momentum * runningMean[i][0] + (1.0 - momentum) * mean;
+            runningVar[i][0] = momentum * runningVar[i][0] + (1.0 - momentum) * variance;
+
+            // Normalize, scale and shift in the second pass
+            const double scale = invStd[i];
+            const double g = gamma[i][0];
+            const double s = beta[i][0];
+            double* xhat = normalized[i].getData();
+            double* z = activationCache[i].getData();
+            for (int b = 0; b < batch; ++b) {
+                xhat[b] = (x[b] - mean) * scale;
+                z[b] = g * xhat[b] + s;
+            }
+        }
+
+        return applyActivation(activationCache, activation);
+    }
+
+    Tensor2<double> predict(const Tensor2<double>& input) const override {
+        Tensor2<double> z(input.getShape());
+        predictInto(input, z);
+        return z;
+    }
+
+    void predictInto(const Tensor2<double>& input, Tensor2<double>& z) const override {
+        checkInput(input);
+        const int batch = input.shape[1];
+        if (z.shape != input.shape) {
+            z = Tensor2<double>(input.shape);
+        }
+
+        for (int i = 0; i < features; ++i) {
+            const double scale = gamma[i][0] / std::sqrt(runningVar[i][0] + epsilon);
+            const double shift = beta[i][0] - runningMean[i][0] * scale;
+            const double* x = input[i].getData();
+            double* out = z[i].getData();
+            for (int b = 0; b < batch; ++b) {
+                out[b] = x[b] * scale + shift;
+            }
+        }
+
+        applyActivationInPlace(z, activation);
+    }
+
+    Tensor2<double> backward(const Tensor2<double>& dA) override {
+        Tensor2<double> dZ = applyActivationDerivative(dA, activationCache, activation);
+        const int batch = dZ.getShape()[1];
+        Tensor2<double> dInput(dZ.getShape());
+
+        for (int i = 0; i < features; ++i) {
+            const double* dz = dZ[i].getData();
+            const double* xhat = normalized[i].getData();
+            double gammaGrad = 0.0;
+            double betaGrad = 0.0;
+            for (int b = 0; b < batch; ++b) {
+                gammaGrad += dz[b] * xhat[b];
+                betaGrad += dz[b];
+            }
+
+            // dx = gamma * invStd / m * (m * dz - sum(dz) - xhat * sum(dz * xhat))
+            const double scale = gamma[i][0] * invStd[i] / batch;
+            double* dx = dInput[i].getData();
+            for (int b = 0; b < batch; ++b) {
+                dx[b] = scale * (batch * dz[b] - betaGrad - xhat[b] * gammaGrad);
+            }
+
+            dGamma[i][0] += gammaGrad;
+            dBeta[i][0] += betaGrad;
+        }
+
+        return dInput;
+    }
+
+    // Running statistics are not trained, so only gamma and beta are exposed
+    std::vector<Parameter> parameters() override {
+        return { { &gamma, &dGamma }, { &beta, &dBeta } };
+    }
+
+    Tensor2<double>& getGamma() {
+        return gamma;
+    }
+
+    Tensor2<double>& getBeta() {
+        return beta;
+    }
+
+    Tensor2<double>& getRunningMean() {
+        return runningMean;
+    }
+
+    Tensor2<double>& getRunningVar() {
+        return runningVar;
+    }
+
+    Activation getActivation() const {
+        return activation;
+    }
+
+    void setActivation(Activation newActivation) {
+        activation = newActivation;
+    }
+
+    double getEpsilon() const {
+        return epsilon;
+    }
+
+    int getOutputSize() const override {
+        return features;
+    }
+
+    std::vector<Tensor2<double>*> buffers() override {
+        return { &runningMean, &runningVar };
+    }
+
+    // The normalized input, the pre-activation and one inverse deviation per feature
+    size_t trainingCacheBytes(int /*inputWidth*/, int batchSize) const override {
+        return sizeof(double) * (2 * static_cast<size_t>(features) * batchSize + features);
+    }
+
+    // Backward: the pre-activation gradient and the derivative it is built from
+    size_t trainingWorkspaceBytes(int /*inputWidth*/, int batchSize, bool backward) const override {
+        return backward ? 2 * sizeof(double) * static_cast<size_t>(features) * batchSize : 0;
+    }
+
+    void releaseCache() override {
+        normalized = Tensor2<double>();
+        activationCache = Tensor2<double>();
+        invStd = std::vector<double>();
+    }
+
+    Layer* clone() const override {
+        return new BatchNorm(*this);
+    }
+
+private:
+    int features;
+    Activation activation;
+    double momentum;
+    double epsilon;
+    Tensor2<double> gamma;
+    Tensor2<double> beta;
+    Tensor2<double> runningMean;
+    Tensor2<double> runningVar;
+    Tensor2<double> dGamma;
+    Tensor2<double> dBeta;
+
+    // Training caches
+    Tensor2<double> normalized;
+    Tensor2<double> activationCache;
+    std::vector<double> invStd;
+
+    void checkInput(const Tensor2<double>& input) const {
+        if (input.shape[0] != features) {
+            std::cerr << "BatchNorm input must have one row per feature" << std::endl;
+            throw std::invalid_argument("BatchNorm input must have one row per feature");
+        }
+    }
+};
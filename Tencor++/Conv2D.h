@@ -0,0 +1,287 @@
+#pragma once
+#include "Layer.h"
+#include "Tensor.h"
+#include "Model.h"
+#include <cstring>
+
+// 2D convolution over inputs laid out as (channels * height * width) x batch, channel-major,
+// which is what Tensor3::flatten(1) + transpose produces for single-channel images.
+// The output uses the same layout, so it can feed another Conv2D or a Dense head directly.
+class Conv2D : public Layer {
+public:
+    Conv2D(int inChannels, int inHeight, int inWidth, int outChannels, int kernelSize,
+           int stride = 1, int padding = 0, Activation activation = LINEAR)
+        : inChannels(inChannels), inHeight(inHeight), inWidth(inWidth), outChannels(outChannels),
+          kernelSize(kernelSize), stride(stride), padding(padding), activation(activation) {
+        if (stride <= 0 || padding < 0 || kernelSize <= 0 || kernelSize > inHeight + 2 * padding || kernelSize > inWidth + 2 * padding) {
+            std::cerr << "Invalid convolution geometry" << std::endl;
+            throw std::invalid_argument("Invalid convolution geometry");
+        }
+        outHeight = (inHeight + 2 * padding - kernelSize) / stride + 1;
+        outWidth = (inWidth + 2 * padding - kernelSize) / stride + 1;
+
+        weights = Tensor2<double>({ outChannels, inChannels * kernelSize * kernelSize }, InitType::Random);
+        biases = Tensor2<double>({ outChannels, 1 }, InitType::Random);
+        dWeights = Tensor2<double>(weights.getShape());
+        dBiases = Tensor2<double>({ outChannels, 1 });
+        cache = nullptr;
+    }
+
+    ~Conv2D() {
+        delete cache;
+    }
+
+    Tensor2<double> forward(const Tensor2<double>& input, bool training = false) override {
+        if (!training) {
+            return predict(input);
+        }
+
+        model->forwardStack.push(this);
+        Tensor2<double> z = convolve(input);
+        Tensor2<double> a = applyActivation(z, activation);
+
+        if (cache != nullptr) {
+            delete cache;
+            cache = nullptr;
+        }
+
+        // Only the input is kept; the im2col matrix is rebuilt in backward
+        cache = new Cache();
+        cache->input = input;
+        cache->activationCache = std::move(z);
+
+        return a;
+    }
+
+    Tensor2<double> predict(const Tensor2<double>& input) const override {
+        Tensor2<double> z = convolve(input);
+        applyActivationInPlace(z, activation);
+        return z;
+    }
+
+    Tensor2<double> backward(const Tensor2<double>& dA) override {
+        Tensor2<double> dZ = applyActivationDerivative(dA, cache->activationCache, activation);
+        const int batch = dZ.getShape()[1];
+        const int positions = outHeight * outWidth;
+
+        // (outC * P) x batch -> outC x (P * batch), the column order im2col uses
+        Tensor2<double> dZCols({ outChannels, positions * batch });
+        for (int oc = 0; oc < outChannels; ++oc) {
+            double* dst = dZCols[oc].getData();
+            for (int p = 0; p < positions; ++p) {
+                std::memcpy(dst + p * batch, dZ[oc * positions + p].getData(), sizeof(double) * batch);
+            }
+        }
+
+        Tensor2<double> cols = im2col(cache->input);
+        Tensor2<double>::dotInto(dZCols, cols, dWeights, false, true, true);
+        dBiases += Tensor2<double>::sum(dZCols, 1);
+        return col2im(Tensor2<double>::dot(weights, dZCols, true, false), batch);
+    }
+
+    std::vector<Parameter> parameters() override {
+        return { { &weights, &dWeights }, { &biases, &dBiases } };
+    }
+
+    Tensor2<double>& getWeights() {
+        return weights;
+    }
+
+    void setWeights(const Tensor2<double>& newWeights) {
+        weights = newWeights;
+    }
+
+    Tensor2<double>& getBiases() {
+        return biases;
+    }
+
+    void setBiases(const Tensor2<double>& newBiases) {
+        biases = newBiases;
+    }
+
+    int getOutputSize() const override {
+        return outChannels * outHeight * outWidth;
+    }
+
+    // The input and the pre-activation
+    size_t trainingCacheBytes(int inputWidth, int batchSize) const override {
+        return sizeof(double) * (static_cast<size_t>(inputWidth) + getOutputSize()) * batchSize;
+    }
+
+    // Forward: the im2col matrix and the GEMM product, unless the direct 3x3 kernel runs. Backward:
+    // the pre-activation gradient, its derivative and its column layout, the rebuilt im2col matrix
+    // and the column gradient col2im folds back.
+    size_t trainingWorkspaceBytes(int /*inputWidth*/, int batchSize, bool backward) const override {
+        const size_t columns = static_cast<size_t>(inChannels) * kernelSize * kernelSize * outHeight * outWidth * batchSize;
+        const size_t out = static_cast<size_t>(getOutputSize()) * batchSize;
+        if (!backward) {
+            return kernelSize == 3 && stride == 1 ? 0 : sizeof(double) * (columns + out);
+        }
+        return sizeof(double) * (3 * out + 2 * columns);
+    }
+
+    struct Cache {
+        Tensor2<double> input;
+        Tensor2<double> activationCache;
+    };
+
+    void releaseCache() override {
+        delete cache;
+        cache = nullptr;
+    }
+
+    Layer* clone() const override {
+        Conv2D* copy = new Conv2D(*this);
+        copy->cache = nullptr;
+        return copy;
+    }
+
+private:
+    int inChannels;
+    int inHeight;
+    int inWidth;
+    int outChannels;
+    int outHeight;
+    int outWidth;
+    int kernelSize;
+    int stride;
+    int padding;
+    Tensor2<double> weights;
+    Tensor2<double> biases;
+    Tensor2<double> dWeights;
+    Tensor2<double> dBiases;
+    Activation activation;
+    Cache* cache;
+
+    void checkInput(const Tensor2<double>& input) const {
+        if (input.getShape()[0] != inChannels * inHeight * inWidth) {
+            std::cerr << "Conv2D input must have channels * height * width rows" << std::endl;
+            throw std::invalid_argument("Conv2D input must have channels * height * width rows");
+        }
+    }
+
+    Tensor2<double> convolve(const Tensor2<double>& input) const {
+        checkInput(input);
+        if (kernelSize == 3 && stride == 1) {
+            return convolveDirect3x3(input);
+        }
+        return convolveGemm(input);
+    }
+
+    // Unrolls every receptive field into a column: (inC * k * k) x (P * batch).
+    // Rows of the input already hold one pixel across the batch, so each copy is a contiguous run.
+    Tensor2<double> im2col(const Tensor2<double>& input) const {
+        const int batch = input.getShape()[1];
+        Tensor2<double> cols({ inChannels * kernelSize * kernelSize, outHeight * outWidth * batch });
+
+        for (int c = 0; c < inChannels; ++c) {
+            for (int ky = 0; ky < kernelSize; ++ky) {
+                for (int kx = 0; kx < kernelSize; ++kx) {
+                    double* dst = cols[(c * kernelSize + ky) * kernelSize + kx].getData();
+                    for (int oy = 0; oy < outHeight; ++oy) {
+                        int iy = oy * stride - padding + ky;
+                        for (int ox = 0; ox < outWidth; ++ox) {
+                            int ix = ox * stride - padding + kx;
+                            // Padded positions stay zero from construction
+                            if (iy >= 0 && iy < inHeight && ix >= 0 && ix < inWidth) {
+                                std::memcpy(dst + (oy * outWidth + ox) * batch,
+                                            input[(c * inHeight + iy) * inWidth + ix].getData(), sizeof(double) * batch);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        return cols;
+    }
+
+    // Scatter-adds column gradients back onto the input pixels they were copied from
+    Tensor2<double> col2im(const Tensor2<double>& cols, int batch) const {
+        Tensor2<double> result({ inChannels * inHeight * inWidth, batch });
+
+        for (int c = 0; c < inChannels; ++c) {
+            for (int ky = 0; ky < kernelSize; ++ky) {
+                for (int kx = 0; kx < kernelSize; ++kx) {
+                    const double* src = cols[(c * kernelSize + ky) * kernelSize + kx].getData();
+                    for (int oy = 0; oy < outHeight; ++oy) {
+                        int iy = oy * stride - padding + ky;
+                        for (int ox = 0; ox < outWidth; ++ox) {
+                            int ix = ox * stride - padding + kx;
+                            if (iy >= 0 && iy < inHeight && ix >= 0 && ix < inWidth) {
+                                double* dst = result[(c * inHeight + iy) * inWidth + ix].getData();
+                                const double* seg = src + (oy * outWidth + ox) * batch;
+                                for (int b = 0; b < batch; ++b) {
+                                    dst[b] += seg[b];
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        return result;
+    }
+
+    Tensor2<double> convolveGemm(const Tensor2<double>& input) const {
+        const int batch = input.getShape()[1];
+        const int positions = outHeight * outWidth;
+        Tensor2<double> product = Tensor2<double>::dot(weights, im2col(input));
+
+        Tensor2<double> z({ outChannels * positions, batch });
+        for (int oc = 0; oc < outChannels; ++oc) {
+            const double* src = product[oc].getData();
+            const double bias = biases[oc][0];
+            for (int p = 0; p < positions; ++p) {
+                double* dst = z[oc * positions + p].getData();
+                const double* seg = src + p * batch;
+                for (int b = 0; b < batch; ++b) {
+                    dst[b] = seg[b] + bias;
+                }
+            }
+        }
+        return z;
+    }
+
+    // Stride-1 3x3 kernels accumulate straight into the output rows, skipping the 9x im2col buffer
+    Tensor2<double> convolveDirect3x3(const Tensor2<double>& input) const {
+        const int batch = input.getShape()[1];
+        Tensor2<double> z({ outChannels * outHeight * outWidth, batch });
+
+        for (int oc = 0; oc < outChannels; ++oc) {
+            const double* w = weights[oc].getData();
+            const double bias = biases[oc][0];
+            for (int p = 0; p < outHeight * outWidth; ++p) {
+                double* dst = z[oc * outHeight * outWidth + p].getData();
+                for (int b = 0; b < batch; ++b) {
+                    dst[b] = bias;
+                }
+            }
+
+            for (int c = 0; c < inChannels; ++c) {
+                for (int ky = 0; ky < 3; ++ky) {
+                    for (int kx = 0; kx < 3; ++kx) {
+                        const double wk = w[(c * 3 + ky) * 3 + kx];
+                        for (int oy = 0; oy < outHeight; ++oy) {
+                            int iy = oy - padding + ky;
+                            if (iy < 0 || iy >= inHeight) {
+                                continue;
+                            }
+                            for (int ox = 0; ox < outWidth; ++ox) {
+                                int ix = ox - padding + kx;
+                                if (ix < 0 || ix >= inWidth) {
+                                    continue;
+                                }
+                                double* dst = z[(oc * outHeight + oy) * outWidth + ox].getData();
+                                const double* src = input[(c * inHeight + iy) * inWidth + ix].getData();
+                                for (int b = 0; b < batch; ++b) {
+                                    dst[b] += wk * src[b];
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        return z;
+    }
+};
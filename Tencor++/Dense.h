@@ -2,6 +2,7 @@
 #include "Layer.h"
 #include "Tensor.h"
 #include "Model.h"
+#include "Precision.h"
 #include <fstream>  // Include this header for file I/O
 
 class Dense : public Layer {
@@ -9,10 +10,16 @@ public:
     Dense(int inputSize, int outputSize, Activation activation = LINEAR) : inputSize(inputSize), outputSize(outputSize) {
         weights = Tensor2<double>({ outputSize, inputSize }, InitType::Random);
         biases = Tensor2<double>({ outputSize, 1 }, InitType::Random);
+        dWeights = Tensor2<double>({ outputSize, inputSize });
+        dBiases = Tensor2<double>({ outputSize, 1 });
         this->activation = activation;
         cache = nullptr;
     }
 
+    ~Dense() {
+        delete cache;
+    }
+
     void saveWeightsAndBiases(const std::string& weightsFile, const std::string& biasesFile) {
         std::ofstream weightsOut(weightsFile, std::ios::binary);
         std::ofstream biasesOut(biasesFile, std::ios::binary);
@@ -67,42 +74,85 @@ public:
     }
 
     Tensor2<double> forward(const Tensor2<double>& input, bool training = false) override {
+        if (!training) {
+            return predict(input);
+        }
+
         model->forwardStack.push(this);
-        Tensor2<double> z = Tensor2<double>::dot(weights, input) + biases;
+        if (mixedPrecision) {
+            return forwardMixed(input);
+        }
+        Tensor2<double> z = Tensor2<double>::dot(weights, input);
+        z += biases;
         Tensor2<double> a = applyActivation(z, activation);
 
-        if (training) {
-            if (cache != nullptr) {
-                delete cache;
-                cache = nullptr;
-            }
-
-            cache = new Cache();
-            cache->input = input;
-            cache->activationCache = z;
-        } else if (cache != nullptr) {
+        if (cache != nullptr) {
             delete cache;
             cache = nullptr;
         }
 
+        cache = new Cache();
+        cache->input = input;
+        cache->activationCache = std::move(z);
+
         return a;
     }
 
-    Tensor2<double> backward(const Tensor2<double>& dA, double learningRate) override {
+    Tensor2<double> predict(const Tensor2<double>& input) const override {
+        Tensor2<double> z = Tensor2<double>::dot(weights, input);
+        z += biases;
+        applyActivationInPlace(z, activation);
+        return z;
+    }
+
+    void predictInto(const Tensor2<double>& input, Tensor2<double>& output) const override {
+        const int cols = input.shape[1];
+        if (output.shape.size() != 2 || output.shape[0] != outputSize || output.shape[1] != cols) {
+            output = Tensor2<double>({ outputSize, cols });
+        }
+        Tensor2<double>::dotInto(weights, input, output);
+        for (int i = 0; i < outputSize; ++i) {
+            const double bias = biases[i][0];
+            double* row = output[i].getData();
+            for (int j = 0; j < cols; ++j) {
+                row[j] += bias;
+            }
+        }
+        applyActivationInPlace(output, activation);
+    }
+
+    Tensor2<double> predictLogits(const Tensor2<double>& input) const override {
+        Tensor2<double> z = Tensor2<double>::dot(weights, input);
+        z += biases;
+        if (activation != SOFTMAX) {
+            applyActivationInPlace(z, activation);
+        }
+        return z;
+    }
+
+    Tensor2<double> backward(const Tensor2<double>& dA) override {
+        if (mixedPrecision) {
+            return backwardMixed(dA);
+        }
         // Activation backward calculations
         Tensor2<double> dZ = applyActivationDerivative(dA, cache->activationCache, activation);
 
         // Linear backward calculations
-        Tensor2<double> APrev = cache->input;
+        const Tensor2<double>& APrev = cache->input;
 
-        Tensor2<double> dW = Tensor2<double>::dot(dZ, Tensor2<double>::transpose(APrev));
-        Tensor2<double> dB = Tensor2<double>::sum(dZ, 1);
-        Tensor2<double> dAPrev = Tensor2<double>::dot(Tensor2<double>::transpose(weights), dZ);
+        Tensor2<double>::dotInto(dZ, APrev, dWeights, false, true, true);
+        dBiases += Tensor2<double>::sum(dZ, 1);
+        return Tensor2<double>::dot(weights, dZ, true, false);
+    }
 
-        weights -= dW * learningRate;
-        biases -= dB * learningRate;
+    std::vector<Parameter> parameters() override {
+        return { { &weights, &dWeights }, { &biases, &dBiases } };
+    }
 
-        return dAPrev;
+    void setMixedPrecision(bool enabled) override {
+        mixedPrecision = enabled;
+        delete cache;
+        cache = nullptr;
     }
 
     // Getter and Setter for weights and biases
@@ -121,6 +171,40 @@ public:
     void setBiases(const Tensor2<double>& newBiases) {
         biases = newBiases;
     }
+    Activation getActivation() const {
+        return activation;
+    }
+
+    void setActivation(Activation newActivation) {
+        activation = newActivation;
+    }
+
+    int getOutputSize() const override {
+        return outputSize;
+    }
+
+    // The input and the pre-activation, in bfloat16 under mixed precision
+    size_t trainingCacheBytes(int inputWidth, int batchSize) const override {
+        const size_t element = mixedPrecision ? sizeof(uint16_t) : sizeof(double);
+        return element * (static_cast<size_t>(inputWidth) + outputSize) * batchSize;
+    }
+
+    // Forward: the float input and product under mixed precision. Backward: the pre-activation
+    // gradient and the derivative it is built from, and under mixed precision the unpacked caches,
+    // the float gradient and the float weight gradient as well.
+    size_t trainingWorkspaceBytes(int inputWidth, int batchSize, bool backward) const override {
+        const size_t in = static_cast<size_t>(inputWidth) * batchSize;
+        const size_t out = static_cast<size_t>(outputSize) * batchSize;
+        if (!backward) {
+            return mixedPrecision ? sizeof(float) * (in + out) : 0;
+        }
+        size_t bytes = 2 * sizeof(double) * out;
+        if (mixedPrecision) {
+            bytes += sizeof(double) * out + sizeof(float) * (out + 2 * in + static_cast<size_t>(outputSize) * inputWidth);
+        }
+        return bytes;
+    }
+
     std::string getName() const {
         return name;
     }
@@ -128,14 +212,65 @@ public:
     struct Cache {
         Tensor2<double> input;
         Tensor2<double> activationCache;
+        // Mixed precision keeps these instead of the double copies
+        BFloat16Tensor input16;
+        BFloat16Tensor activation16;
     };
 
+    void releaseCache() override {
+        delete cache;
+        cache = nullptr;
+    }
+
+    Layer* clone() const override {
+        Dense* copy = new Dense(*this);
+        copy->cache = nullptr;
+        return copy;
+    }
+
 private:
     int inputSize;
     int outputSize;
     Tensor2<double> weights;
     Tensor2<double> biases;
+    Tensor2<double> dWeights;
+    Tensor2<double> dBiases;
     Activation activation;
     Cache* cache;
     std::string name;
+    bool mixedPrecision = false;
+    // Float copy of the weights taken at the last training forward, reused by its backward
+    Tensor2<float> weights32;
+
+    // Both GEMMs in float, the bias and activation in double; the cache holds bfloat16
+    Tensor2<double> forwardMixed(const Tensor2<double>& input) {
+        weights32 = convertTensor<float>(weights);
+        Tensor2<double> z = convertTensor<double>(Tensor2<float>::dot(weights32, convertTensor<float>(input)));
+        z += biases;
+        Tensor2<double> a = applyActivation(z, activation);
+
+        delete cache;
+        cache = new Cache();
+        cache->input16 = BFloat16Tensor(input);
+        cache->activation16 = BFloat16Tensor(z);
+        return a;
+    }
+
+    Tensor2<double> backwardMixed(const Tensor2<double>& dA) {
+        Tensor2<double> z = cache->activation16.unpack<double>();
+        Tensor2<double> dZ = applyActivationDerivative(dA, z, activation);
+        Tensor2<float> dZ32 = convertTensor<float>(dZ);
+
+        Tensor2<float> dW32({ outputSize, inputSize });
+        Tensor2<float>::dotInto(dZ32, cache->input16.unpack<float>(), dW32, false, true);
+        for (int i = 0; i < outputSize; ++i) {
+            const float* src = dW32[i].getData();
+            double* dst = dWeights[i].getData();
+            for (int j = 0; j < inputSize; ++j) {
+                dst[j] += src[j];
+            }
+        }
+        dBiases += Tensor2<double>::sum(dZ, 1);
+        return convertTensor<double>(Tensor2<float>::dot(weights32, dZ32, true, false));
+    }
 };
\ No newline at end of file
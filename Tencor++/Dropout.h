@@ -0,0 +1,125 @@
+#pragma once
+#include "Layer.h"
+#include "Tensor.h"
+#include "Model.h"
+#include <vector>
+#include <cstdint>
+
+// Inverted dropout: training zeroes each element with probability `rate` and scales the survivors
+// by 1 / (1 - rate), so inference is a plain identity that Sequential skips without copying.
+class Dropout : public Layer {
+public:
+    Dropout(double rate, uint32_t seed = 0) : rate(rate), seed(seed), counter(0), rows(0), cols(0) {
+        if (rate < 0.0 || rate >= 1.0) {
+            std::cerr << "Dropout rate must be in [0, 1)" << std::endl;
+            throw std::invalid_argument("Dropout rate must be in [0, 1)");
+        }
+        dropThreshold = static_cast<uint32_t>(rate * 4294967296.0);
+        scale = 1.0 / (1.0 - rate);
+    }
+
+    Tensor2<double> forward(const Tensor2<double>& input, bool training = false) override {
+        if (!training) {
+            return predict(input);
+        }
+
+        model->forwardStack.push(this);
+        rows = input.getShape()[0];
+        cols = input.getShape()[1];
+        // One bit per element instead of a Tensor2<double> mask
+        mask.assign((static_cast<size_t>(rows) * cols + 63) / 64, 0);
+
+        // Counter-based stream: every element hashes its own index, so there is no serial RNG state
+        // in the loop and the generator vectorizes like any other elementwise kernel
+        const uint32_t key = hash(seed ^ hash(counter++));
+        Tensor2<double> result(input.getShape());
+
+        for (int i = 0; i < rows; ++i) {
+            const double* x = input[i].getData();
+            double* out = result[i].getData();
+            const size_t base = static_cast<size_t>(i) * cols;
+            for (int j = 0; j < cols; ++j) {
+                const size_t index = base + j;
+                const bool keep = hash(static_cast<uint32_t>(index) * 0x9E3779B9u + key) >= dropThreshold;
+                out[j] = keep ? x[j] * scale : 0.0;
+                mask[index >> 6] |= static_cast<uint64_t>(keep) << (index & 63);
+            }
+        }
+
+        return result;
+    }
+
+    Tensor2<double> predict(const Tensor2<double>& input) const override {
+        return input;
+    }
+
+    bool isInferenceIdentity() const override {
+        return true;
+    }
+
+    Tensor2<double> backward(const Tensor2<double>& dA) override {
+        Tensor2<double> dInput({ rows, cols });
+
+        for (int i = 0; i < rows; ++i) {
+            const double* grad = dA[i].getData();
+            double* dx = dInput[i].getData();
+            const size_t base = static_cast<size_t>(i) * cols;
+            for (int j = 0; j < cols; ++j) {
+                const size_t index = base + j;
+                dx[j] = ((mask[index >> 6] >> (index & 63)) & 1) ? grad[j] * scale : 0.0;
+            }
+        }
+
+        return dInput;
+    }
+
+    double getRate() const {
+        return rate;
+    }
+
+    uint32_t getRandomState() const override {
+        return counter;
+    }
+
+    void setRandomState(uint32_t state) override {
+        counter = state;
+    }
+
+    // Gives a replica its own mask stream, so data-parallel shards do not drop the same positions
+    void setStream(uint32_t stream) {
+        seed = hash(seed + 0x9E3779B9u * (stream + 1));
+    }
+
+    // One mask bit per element
+    size_t trainingCacheBytes(int inputWidth, int batchSize) const override {
+        return sizeof(uint64_t) * ((static_cast<size_t>(inputWidth) * batchSize + 63) / 64);
+    }
+
+    void releaseCache() override {
+        mask = std::vector<uint64_t>();
+    }
+
+    Layer* clone() const override {
+        return new Dropout(*this);
+    }
+
+private:
+    double rate;
+    double scale;
+    uint32_t dropThreshold;
+    uint32_t seed;
+    uint32_t counter;
+    int rows;
+    int cols;
+    std::vector<uint64_t> mask;
+
+    // 32-bit integer finalizer (lowbias32): cheap multiplies and shifts only
+    static uint32_t hash(uint32_t x) {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+};
@@ -0,0 +1,135 @@
+#pragma once
+#include "Layer.h"
+#include "Tensor.h"
+#include "Model.h"
+#include <vector>
+
+// Looks up integer ids in a (vocabSize x embeddingDim) table.
+// Input: (tokens x batch) ids stored as doubles, the same way labels are stored.
+// Output: (tokens * embeddingDim) x batch, token-major, so a sequence feeds recurrent layers directly.
+class Embedding : public Layer {
+public:
+    Embedding(int vocabSize, int embeddingDim) : vocabSize(vocabSize), embeddingDim(embeddingDim), tokens(0), batchSize(0) {
+        table = Tensor2<double>({ vocabSize, embeddingDim }, InitType::Random);
+        dTable = SparseGradient(embeddingDim);
+    }
+
+    Tensor2<double> forward(const Tensor2<double>& input, bool training = false) override {
+        if (!training) {
+            return predict(input);
+        }
+
+        model->forwardStack.push(this);
+        tokens = input.getShape()[0];
+        batchSize = input.getShape()[1];
+        // Only the ids are kept; backward touches just the rows they name
+        ids.resize(static_cast<size_t>(tokens) * batchSize);
+        for (int t = 0; t < tokens; ++t) {
+            for (int b = 0; b < batchSize; ++b) {
+                ids[static_cast<size_t>(t) * batchSize + b] = toId(input[t][b]);
+            }
+        }
+
+        return gather(input);
+    }
+
+    Tensor2<double> predict(const Tensor2<double>& input) const override {
+        return gather(input);
+    }
+
+    // Sparse gradient: only the looked-up rows get a compact gradient row, so cost and memory
+    // scale with tokens * batch * embeddingDim, never with vocabSize
+    Tensor2<double> backward(const Tensor2<double>& dA) override {
+        for (int t = 0; t < tokens; ++t) {
+            for (int b = 0; b < batchSize; ++b) {
+                const int id = ids[static_cast<size_t>(t) * batchSize + b];
+                double* row = dTable.row(id);
+                for (int d = 0; d < embeddingDim; ++d) {
+                    row[d] += dA[t * embeddingDim + d][b];
+                }
+            }
+        }
+
+        // Ids are not differentiable
+        return Tensor2<double>({ tokens, batchSize });
+    }
+
+    std::vector<Parameter> parameters() override {
+        return { { &table, nullptr, &dTable } };
+    }
+
+    Tensor2<double>& getTable() {
+        return table;
+    }
+
+    void setTable(const Tensor2<double>& newTable) {
+        table = newTable;
+    }
+
+    int getOutputSize() const override {
+        return tokens * embeddingDim;
+    }
+
+    // One embedding per input row, whatever the last training batch held
+    int getOutputWidth(int inputWidth) const override {
+        return inputWidth < 0 ? -1 : inputWidth * embeddingDim;
+    }
+
+    // One id per token and column
+    size_t trainingCacheBytes(int inputWidth, int batchSize) const override {
+        return sizeof(int) * inputWidth * static_cast<size_t>(batchSize);
+    }
+
+    void releaseCache() override {
+        ids = std::vector<int>();
+    }
+
+    Layer* clone() const override {
+        return new Embedding(*this);
+    }
+
+    // The table is what makes an embedding large, and the replica is about to view ours
+    Layer* cloneShared() const override {
+        return new Embedding(vocabSize, embeddingDim, Unallocated());
+    }
+
+private:
+    struct Unallocated {};
+
+    Embedding(int vocabSize, int embeddingDim, Unallocated)
+        : vocabSize(vocabSize), embeddingDim(embeddingDim), tokens(0), batchSize(0), dTable(embeddingDim) {}
+
+    int vocabSize;
+    int embeddingDim;
+    int tokens;
+    int batchSize;
+    Tensor2<double> table;
+    SparseGradient dTable;
+    std::vector<int> ids;
+
+    int toId(double value) const {
+        int id = static_cast<int>(value);
+        if (id < 0 || id >= vocabSize) {
+            std::cerr << "Embedding id out of range: " << id << std::endl;
+            throw std::out_of_range("Embedding id out of range");
+        }
+        return id;
+    }
+
+    Tensor2<double> gather(const Tensor2<double>& input) const {
+        const int inputTokens = input.getShape()[0];
+        const int batch = input.getShape()[1];
+        Tensor2<double> result({ inputTokens * embeddingDim, batch });
+
+        for (int t = 0; t < inputTokens; ++t) {
+            const double* idRow = input[t].getData();
+            for (int b = 0; b < batch; ++b) {
+                const double* row = table[toId(idRow[b])].getData();
+                for (int d = 0; d < embeddingDim; ++d) {
+                    result[t * embeddingDim + d][b] = row[d];
+                }
+            }
+        }
+        return result;
+    }
+};
@@ -0,0 +1,44 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <vector>
+
+// What a fusion pass rewrote. Each entry removes one intermediate activation tensor of
+// bytesPerSample * batch bytes from every forward (and its cached copy from every training step).
+struct FusionReport {
+    struct Entry {
+        std::string pattern;
+        std::string result;
+        size_t bytesPerSample;
+    };
+
+    std::vector<Entry> entries;
+
+    void add(const std::string& pattern, const std::string& result, size_t bytesPerSample) {
+        entries.push_back({ pattern, result, bytesPerSample });
+    }
+
+    void merge(const FusionReport& other) {
+        entries.insert(entries.end(), other.entries.begin(), other.entries.end());
+    }
+
+    size_t bytesSaved(int batchSize = 1) const {
+        size_t total = 0;
+        for (const Entry& entry : entries) {
+            total += entry.bytesPerSample;
+        }
+        return total * batchSize;
+    }
+
+    void print(int batchSize = 1, std::ostream& out = std::cout) const {
+        out << "Fusion report: " << entries.size() << " fusion(s)" << std::endl;
+        for (const Entry& entry : entries) {
+            out << "  " << entry.pattern << "  =>  " << entry.result;
+            if (entry.bytesPerSample > 0) {
+                out << " (saves " << entry.bytesPerSample * batchSize << " bytes)";
+            }
+            out << std::endl;
+        }
+        out << "Total saved per forward at batch " << batchSize << ": " << bytesSaved(batchSize) << " bytes" << std::endl;
+    }
+};
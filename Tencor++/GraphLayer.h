@@ -0,0 +1,108 @@
+#pragma once
+#include "Layer.h"
+#include "Tensor.h"
+#include "Model.h"
+#include "Autograd.h"
+#include <functional>
+#include <vector>
+
+// Layer whose forward is written with Graph ops; backward replays the recorded graph, so blocks with
+// branches need no hand-written gradient. A residual block, for example:
+//
+//   GraphLayer block([](Graph& g, Graph::Var x, const std::vector<Graph::Var>& p) {
+//       return g.add(x, g.tanh(g.add(g.matmul(p[0], x), p[1])));
+//   });
+//   block.addParameter({ 16, 16 });
+//   block.addParameter({ 16, 1 });
+//
+// The graph's arena is reused from step to step, so recording costs no allocations once warm.
+// Pass the rows the function produces as outputSize (16 above) for Sequential to plan memory around it.
+class GraphLayer : public Layer {
+public:
+    using Function = std::function<Graph::Var(Graph& graph, Graph::Var input, const std::vector<Graph::Var>& parameters)>;
+
+    GraphLayer(Function function, int outputSize = 0) : function(function), outputSize(outputSize), inputVar{ -1 }, outputVar{ -1 } {}
+
+    // Returns the index the function finds the parameter at
+    int addParameter(const std::vector<int>& shape, InitType init = InitType::Random) {
+        values.emplace_back(shape, init);
+        grads.emplace_back(shape);
+        return static_cast<int>(values.size()) - 1;
+    }
+
+    Tensor2<double>& getParameter(int index) {
+        return values[index];
+    }
+
+    Tensor2<double> forward(const Tensor2<double>& input, bool training = false) override {
+        if (!training) {
+            return predict(input);
+        }
+
+        model->forwardStack.push(this);
+        graph.reset();
+        std::vector<Graph::Var> bound;
+        for (size_t i = 0; i < values.size(); ++i) {
+            bound.push_back(graph.parameter(values[i], &grads[i]));
+        }
+        inputVar = graph.input(input, true);
+        outputVar = function(graph, inputVar, bound);
+        return graph.value(outputVar);
+    }
+
+    // Records into a local graph with constant parameters, leaving the training graph untouched
+    Tensor2<double> predict(const Tensor2<double>& input) const override {
+        Graph local;
+        std::vector<Graph::Var> bound;
+        for (const Tensor2<double>& value : values) {
+            bound.push_back(local.parameter(value));
+        }
+        return local.value(function(local, local.input(input), bound));
+    }
+
+    Tensor2<double> backward(const Tensor2<double>& dA) override {
+        graph.backward(outputVar, dA);
+        return graph.gradient(inputVar);
+    }
+
+    std::vector<Parameter> parameters() override {
+        std::vector<Parameter> result;
+        for (size_t i = 0; i < values.size(); ++i) {
+            result.push_back({ &values[i], &grads[i] });
+        }
+        return result;
+    }
+
+    int getOutputSize() const override {
+        return outputSize;
+    }
+
+    // The function may change the width, so without an outputSize it is unknown until a forward
+    int getOutputWidth(int /*inputWidth*/) const override {
+        return outputSize > 0 ? outputSize : -1;
+    }
+
+    // What the arena holds from the last step; the function's shape is opaque, so before the first step this is 0
+    size_t trainingCacheBytes(int /*inputWidth*/, int /*batchSize*/) const override {
+        return graph.bytes();
+    }
+
+    void releaseCache() override {
+        graph.clear();
+    }
+
+    Layer* clone() const override {
+        GraphLayer* copy = new GraphLayer(*this);
+        copy->graph.clear();
+        return copy;
+    }
+
+private:
+    Function function;
+    int outputSize;
+    std::vector<Tensor2<double>> values;
+    std::vector<Tensor2<double>> grads;
+    Graph graph;
+    Graph::Var inputVar;
+    Graph::Var outputVar;
+};
@@ -1,6 +1,9 @@
 #pragma once
 #include "Tensor.h"
 #include <math.h>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
 
 enum Activation {
 	LINEAR,
@@ -10,6 +13,23 @@ enum Activation {
 	SOFTMAX
 };
 
+const char* activationName(Activation activation) {
+	switch (activation) {
+	case LINEAR:
+		return "LINEAR";
+	case RELU:
+		return "RELU";
+	case SIGMOID:
+		return "SIGMOID";
+	case TANH:
+		return "TANH";
+	case SOFTMAX:
+		return "SOFTMAX";
+	default:
+		return "UNKNOWN";
+	}
+}
+
 Tensor2<double> applyActivation(Tensor2<double>& input, Activation activation) {
 	switch (activation) {
 	case LINEAR:
@@ -20,17 +40,68 @@ Tensor2<double> applyActivation(Tensor2<double>& input, Activation activation) {
 		return input.apply([](double x) { return x > 0 ? x : 0.0; });
 	case TANH:
 		return input.apply([](double x) { return tanh(x); });
-    case SOFTMAX: {
-		// Tensor2<double> max = Tensor2<double>::max(input, 0);
-		Tensor2<double> exps = input.apply([](double x) { return exp(x); });
-		Tensor2<double> sums = Tensor2<double>::sum(exps, 0);
-		return exps / sums;
-    }
+    case SOFTMAX:
+		return Tensor2<double>::softmax(input, 0);
 	default:
 		throw std::invalid_argument("Invalid activation function");
 	}
 }
 
+// Overwrites z with its activation; LINEAR leaves it untouched instead of copying
+void applyActivationInPlace(Tensor2<double>& z, Activation activation) {
+	const int rows = z.shape[0];
+	const int cols = z.shape[1];
+	switch (activation) {
+	case LINEAR:
+		return;
+	case SOFTMAX:
+		// Tensor2::softmax's online max and sum, a column at a time, so z keeps its storage
+		for (int j = 0; j < cols; ++j) {
+			double maxVal = z[0][j];
+			double sum = 1;
+			for (int i = 1; i < rows; ++i) {
+				const double value = z[i][j];
+				if (value > maxVal) {
+					sum = sum * exp(maxVal - value) + 1;
+					maxVal = value;
+				}
+				else {
+					sum += exp(value - maxVal);
+				}
+			}
+			for (int i = 0; i < rows; ++i) {
+				z[i][j] = exp(z[i][j] - maxVal) / sum;
+			}
+		}
+		return;
+	default:
+		break;
+	}
+
+	for (int i = 0; i < rows; ++i) {
+		double* row = z[i].getData();
+		switch (activation) {
+		case SIGMOID:
+			for (int j = 0; j < cols; ++j) {
+				row[j] = 1.0 / (1.0 + exp(-row[j]));
+			}
+			break;
+		case RELU:
+			for (int j = 0; j < cols; ++j) {
+				row[j] = row[j] > 0 ? row[j] : 0.0;
+			}
+			break;
+		case TANH:
+			for (int j = 0; j < cols; ++j) {
+				row[j] = tanh(row[j]);
+			}
+			break;
+		default:
+			throw std::invalid_argument("Invalid activation function");
+		}
+	}
+}
+
 Tensor2<double> applyActivationDerivative(const Tensor2<double>& dA, Tensor2<double>& Z, Activation activation) {
 	switch (activation) {
 	case LINEAR:
@@ -56,11 +127,154 @@ Tensor2<double> applyActivationDerivative(const Tensor2<double>& dA, Tensor2<dou
 
 class Model;
 
+// Gradient of a parameter that a step only touches a few rows of (an embedding table). It holds one
+// compact row per touched parameter row, each listed once, so its size follows the rows a step used
+// and never the parameter's. Clearing keeps the capacity, so a warm table allocates nothing.
+class SparseGradient {
+public:
+	explicit SparseGradient(int cols = 0) : cols(cols) {}
+
+	// Accumulation target for parameter row `row`, zero-filled when the row is first touched. Valid
+	// until the next row is added.
+	double* row(int row) {
+		auto found = slots.find(row);
+		if (found != slots.end()) {
+			return data.data() + static_cast<size_t>(found->second) * cols;
+		}
+		slots.emplace(row, static_cast<int>(rows.size()));
+		rows.push_back(row);
+		data.resize(data.size() + cols, 0.0);
+		return data.data() + data.size() - cols;
+	}
+
+	// Touched rows in the order they were first touched
+	int size() const {
+		return static_cast<int>(rows.size());
+	}
+
+	int getCols() const {
+		return cols;
+	}
+
+	// Parameter row the k-th compact row belongs to, and that row's values
+	int rowIndex(int k) const {
+		return rows[k];
+	}
+
+	double* values(int k) {
+		return data.data() + static_cast<size_t>(k) * cols;
+	}
+
+	// this += other, leaving other empty
+	void absorb(SparseGradient& other) {
+		for (int k = 0; k < other.size(); ++k) {
+			const double* source = other.values(k);
+			double* target = row(other.rowIndex(k));
+			for (int j = 0; j < cols; ++j) {
+				target[j] += source[j];
+			}
+		}
+		other.clear();
+	}
+
+	void clear() {
+		rows.clear();
+		data.clear();
+		slots.clear();
+	}
+
+private:
+	int cols;
+	std::vector<int> rows;
+	std::vector<double> data;
+	std::unordered_map<int, int> slots;
+};
+
+// A trainable tensor and the gradient its layer accumulates for it between optimizer steps. Sparse
+// parameters (embedding tables) have no dense gradient; theirs is a SparseGradient instead.
+struct Parameter {
+	Tensor2<double>* value;
+	Tensor2<double>* grad;
+	SparseGradient* sparse = nullptr;
+};
+
 class Layer {
 public:
+	virtual ~Layer() {}
 	virtual Tensor2<double> forward(const Tensor2<double>& input, bool training = false) = 0;
-	virtual Tensor2<double> backward(const Tensor2<double>& outputGradient, double learningRate) = 0;
-	//int getOutputSize();
+	// Accumulates parameter gradients and returns the gradient for the input; the model's optimizer applies them
+	virtual Tensor2<double> backward(const Tensor2<double>& outputGradient) = 0;
+	// Inference-only pass: records nothing on the model's tape and allocates no cache. Scratch stays
+	// local to the call, so any number of threads may run it at once while nothing trains.
+	virtual Tensor2<double> predict(const Tensor2<double>& input) const = 0;
+	// predict into an existing tensor, keeping its storage when the shape fits (planned inference).
+	// Layers that can write in place override it; the default copies predict's result over.
+	virtual void predictInto(const Tensor2<double>& input, Tensor2<double>& output) const {
+		Tensor2<double> result = predict(input);
+		if (output.shape != result.shape) {
+			output = std::move(result);
+			return;
+		}
+		for (int i = 0; i < result.shape[0]; ++i) {
+			std::copy(result[i].getData(), result[i].getData() + result.shape[1], output[i].getData());
+		}
+	}
+	// Layers that pass their input through unchanged at inference are skipped by the model
+	virtual bool isInferenceIdentity() const {
+		return false;
+	}
+	// Same as predict but stops before a trailing softmax; argmax over either result is identical
+	virtual Tensor2<double> predictLogits(const Tensor2<double>& input) const {
+		return predict(input);
+	}
+	virtual std::vector<Parameter> parameters() {
+		return {};
+	}
+	// Non-trained state that replicas must hand back to the model (BatchNorm running statistics)
+	virtual std::vector<Tensor2<double>*> buffers() {
+		return {};
+	}
+	// Same weights, fresh caches and no model; used to build per-thread replicas
+	virtual Layer* clone() const = 0;
+	// clone for a replica whose parameter values Model::shareParameters replaces with views right
+	// after; layers with large tables override it to leave them unallocated instead of copying them
+	virtual Layer* cloneShared() const {
+		return clone();
+	}
+	// Frees what the last training forward kept for backward; checkpointing recomputes it later
+	virtual void releaseCache() {
+	}
+	// Layers with a reduced-precision training path (float GEMMs, bfloat16 caches) switch to it here;
+	// the rest keep training in double
+	virtual void setMixedPrecision(bool /*enabled*/) {
+	}
+	// Hidden per-call state such as Dropout's RNG counter. A forward that is recomputed during
+	// backward restores the state captured before the original forward, so both see the same masks.
+	virtual uint32_t getRandomState() const {
+		return 0;
+	}
+	virtual void setRandomState(uint32_t /*state*/) {
+	}
+	// Feature rows produced per sample, or 0 when the layer keeps the size of its input
+	virtual int getOutputSize() const {
+		return 0;
+	}
+	// Feature rows produced per sample from inputWidth rows in; -1 when either is unknown. Layers
+	// whose output depends on the input's width override this rather than getOutputSize.
+	virtual int getOutputWidth(int inputWidth) const {
+		const int produced = getOutputSize();
+		return produced > 0 ? produced : inputWidth;
+	}
+	// Bytes a training forward over batchSize columns of inputWidth rows leaves behind for backward,
+	// beyond the output it returns: cached inputs, pre-activations, masks, saved sequences
+	virtual size_t trainingCacheBytes(int /*inputWidth*/, int /*batchSize*/) const {
+		return 0;
+	}
+	// Scratch a training forward (or backward) allocates and drops before returning, not counting its
+	// result: im2col matrices, float copies, pre-activation gradients, attention tiles
+	virtual size_t trainingWorkspaceBytes(int /*inputWidth*/, int /*batchSize*/, bool /*backward*/) const {
+		return 0;
+	}
 	void setModel(Model* model) {
 		this->model = model;
 	}
@@ -57,6 +57,24 @@ public:
         size++;
     }
 
+    // Unlinks and frees a node obtained from getHead()/next
+    void remove(Node<T>* node) {
+        if (node->prev != nullptr) {
+            node->prev->next = node->next;
+        } else {
+            head = node->next;
+        }
+
+        if (node->next != nullptr) {
+            node->next->prev = node->prev;
+        } else {
+            tail = node->prev;
+        }
+
+        delete node;
+        size--;
+    }
+
     void print() const {
         Node<T>* temp = head;
         std::cout << "[";
@@ -1,11 +1,49 @@
 #pragma once
 #include "Tensor.h"
 
+// How a loss's gradient treats the batch's columns. Sum leaves each column's gradient as its own
+// sample's, so the gradients of column slices simply add up to the batch's. Mean divides every column
+// by the batch width, so a slice's gradient is too large by the batch width over the slice's.
+enum class LossReduction {
+	Sum,
+	Mean
+};
+
 template <typename T>
 class Loss {
 public:
 	virtual T forward(const Tensor2<T>& Y_Pred, const Tensor2<T>& Y_True) = 0;
 	virtual Tensor2<T> backward(const Tensor2<T>& Y_Pred, const Tensor2<T>& Y_True) = 0;
+
+	// Loss and gradient for the same prediction; losses override this with a single fused pass
+	virtual T forwardBackward(const Tensor2<T>& Y_Pred, const Tensor2<T>& Y_True, Tensor2<T>& grad) {
+		grad = backward(Y_Pred, Y_True);
+		return forward(Y_Pred, Y_True);
+	}
+
+	virtual LossReduction reduction() const {
+		return LossReduction::Sum;
+	}
+
+	// Factor that turns the gradient of a part-column slice into its share of the gradient of the
+	// whole-column batch it came from
+	T gradientWeight(int part, int whole) const {
+		return reduction() == LossReduction::Mean ? static_cast<T>(part) / whole : static_cast<T>(1);
+	}
+
+	// Applies gradientWeight to grad, a slice's gradient, in place
+	void weightSliceGradient(Tensor2<T>& grad, int whole) const {
+		const T weight = gradientWeight(grad.getShape()[1], whole);
+		if (weight == static_cast<T>(1)) {
+			return;
+		}
+		for (int i = 0; i < grad.getShape()[0]; ++i) {
+			T* g = grad[i].getData();
+			for (int j = 0; j < grad.getShape()[1]; ++j) {
+				g[j] *= weight;
+			}
+		}
+	}
 };
 
 template <typename T>
@@ -21,6 +59,10 @@ public:
 
 		return dY;
 	}
+
+	LossReduction reduction() const override {
+		return LossReduction::Mean;
+	}
 };
 
 template <typename T>
@@ -37,6 +79,10 @@ class BinaryCrossEntropy : public Loss<T> {
 
 		return dY;
 	}
+
+	LossReduction reduction() const override {
+		return LossReduction::Mean;
+	}
 };
 
 template <typename T>
@@ -53,4 +99,123 @@ class CategoricalCrossEntropy : public Loss<T> {
 
 		return dY;
 	}
+
+	T forwardBackward(const Tensor2<T>& Y_Pred, const Tensor2<T>& Y_True, Tensor2<T>& grad) override {
+		grad = Tensor2<T>(Y_Pred.getShape());
+		T loss = 0;
+		for (int i = 0; i < Y_Pred.getShape()[0]; ++i) {
+			const T* p = Y_Pred[i].getData();
+			const T* y = Y_True[i].getData();
+			T* g = grad[i].getData();
+			for (int j = 0; j < Y_Pred.getShape()[1]; ++j) {
+				g[j] = p[j] - y[j];
+				// Skip zero targets so a saturated probability cannot turn into 0 * -inf
+				if (y[j] != 0) {
+					loss -= y[j] * std::log(p[j] > 1e-300 ? p[j] : 1e-300);
+				}
+			}
+		}
+
+		return loss / Y_True.getShape()[1];
+	}
+};
+
+// Softmax and categorical cross-entropy fused over raw logits; use with a LINEAR output layer.
+// The gradient matches CategoricalCrossEntropy behind a SOFTMAX layer: (p - y).
+template <typename T>
+class CategoricalCrossEntropyWithLogits : public Loss<T> {
+public:
+	T forward(const Tensor2<T>& Y_Pred, const Tensor2<T>& Y_True) override {
+		Tensor2<T> grad;
+		return forwardBackward(Y_Pred, Y_True, grad);
+	}
+
+	Tensor2<T> backward(const Tensor2<T>& Y_Pred, const Tensor2<T>& Y_True) override {
+		Tensor2<T> grad;
+		forwardBackward(Y_Pred, Y_True, grad);
+
+		return grad;
+	}
+
+	T forwardBackward(const Tensor2<T>& Y_Pred, const Tensor2<T>& Y_True, Tensor2<T>& grad) override {
+		const int rows = Y_Pred.getShape()[0];
+		const int cols = Y_Pred.getShape()[1];
+
+		// Pass 1: online column max and rescaled exp-sum
+		std::vector<T> maxVals(Y_Pred[0].getData(), Y_Pred[0].getData() + cols);
+		std::vector<T> sums(cols, 1);
+		for (int i = 1; i < rows; ++i) {
+			const T* z = Y_Pred[i].getData();
+			for (int j = 0; j < cols; ++j) {
+				if (z[j] > maxVals[j]) {
+					sums[j] = sums[j] * std::exp(maxVals[j] - z[j]) + 1;
+					maxVals[j] = z[j];
+				}
+				else {
+					sums[j] += std::exp(z[j] - maxVals[j]);
+				}
+			}
+		}
+		for (int j = 0; j < cols; ++j) {
+			sums[j] = std::log(sums[j]);
+		}
+
+		// Pass 2: log-softmax, loss and (p - y) together
+		grad = Tensor2<T>(Y_Pred.getShape());
+		T loss = 0;
+		for (int i = 0; i < rows; ++i) {
+			const T* z = Y_Pred[i].getData();
+			const T* y = Y_True[i].getData();
+			T* g = grad[i].getData();
+			for (int j = 0; j < cols; ++j) {
+				T logP = z[j] - maxVals[j] - sums[j];
+				g[j] = std::exp(logP) - y[j];
+				loss -= y[j] * logP;
+			}
+		}
+
+		return loss / cols;
+	}
+};
+
+// Sigmoid and binary cross-entropy fused over raw logits; use with a LINEAR output layer.
+// The gradient matches BinaryCrossEntropy behind a SIGMOID layer: (p - y) / m.
+template <typename T>
+class BinaryCrossEntropyWithLogits : public Loss<T> {
+public:
+	T forward(const Tensor2<T>& Y_Pred, const Tensor2<T>& Y_True) override {
+		Tensor2<T> grad;
+		return forwardBackward(Y_Pred, Y_True, grad);
+	}
+
+	Tensor2<T> backward(const Tensor2<T>& Y_Pred, const Tensor2<T>& Y_True) override {
+		Tensor2<T> grad;
+		forwardBackward(Y_Pred, Y_True, grad);
+
+		return grad;
+	}
+
+	T forwardBackward(const Tensor2<T>& Y_Pred, const Tensor2<T>& Y_True, Tensor2<T>& grad) override {
+		const int cols = Y_Pred.getShape()[1];
+		grad = Tensor2<T>(Y_Pred.getShape());
+		T loss = 0;
+		for (int i = 0; i < Y_Pred.getShape()[0]; ++i) {
+			const T* z = Y_Pred[i].getData();
+			const T* y = Y_True[i].getData();
+			T* g = grad[i].getData();
+			for (int j = 0; j < cols; ++j) {
+				// e = exp(-|z|) never overflows, and both the loss and sigmoid are rebuilt from it
+				T e = std::exp(-std::abs(z[j]));
+				T p = z[j] >= 0 ? 1 / (1 + e) : e / (1 + e);
+				loss += (z[j] > 0 ? z[j] : 0) - z[j] * y[j] + std::log1p(e);
+				g[j] = (p - y[j]) / cols;
+			}
+		}
+
+		return loss / cols;
+	}
+
+	LossReduction reduction() const override {
+		return LossReduction::Mean;
+	}
 };
\ No newline at end of file
@@ -0,0 +1,112 @@
+#pragma once
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Static placement of buffers with known sizes and lifetimes into one slab. A buffer is live from
+// step first to step last inclusive; two buffers may share bytes only if their lifetimes do not
+// overlap. solve() treats this as coloring an interval graph with offsets: buffers are placed
+// largest first, each at the lowest offset that clears every already-placed buffer it overlaps in
+// time. The result is compared with naive allocation (every buffer separate) and with the lower
+// bound no placement can beat (the most bytes live at any one step).
+class MemoryPlan {
+public:
+    struct Buffer {
+        std::string name;
+        size_t bytes;
+        int first;
+        int last;
+        size_t offset;
+    };
+
+    // Returns the buffer's index; sizes are rounded up to a cache line
+    int add(const std::string& name, size_t bytes, int first, int last) {
+        buffers.push_back({ name, (bytes + alignment - 1) / alignment * alignment, first, last, 0 });
+        return static_cast<int>(buffers.size()) - 1;
+    }
+
+    void solve() {
+        std::vector<int> placement(buffers.size());
+        for (size_t i = 0; i < buffers.size(); ++i) {
+            placement[i] = static_cast<int>(i);
+        }
+        std::stable_sort(placement.begin(), placement.end(), [&](int a, int b) {
+            return buffers[a].bytes > buffers[b].bytes;
+        });
+
+        std::vector<int> placed;
+        for (int index : placement) {
+            Buffer& buffer = buffers[index];
+            // Byte ranges taken by placed buffers that are live at the same time, by offset
+            std::vector<std::pair<size_t, size_t>> taken;
+            for (int other : placed) {
+                const Buffer& o = buffers[other];
+                if (o.first <= buffer.last && buffer.first <= o.last) {
+                    taken.push_back({ o.offset, o.offset + o.bytes });
+                }
+            }
+            std::sort(taken.begin(), taken.end());
+
+            size_t offset = 0;
+            for (const std::pair<size_t, size_t>& range : taken) {
+                if (offset + buffer.bytes <= range.first) {
+                    break;
+                }
+                offset = std::max(offset, range.second);
+            }
+            buffer.offset = offset;
+            placed.push_back(index);
+        }
+    }
+
+    // Slab size the placement needs
+    size_t peakBytes() const {
+        size_t peak = 0;
+        for (const Buffer& buffer : buffers) {
+            peak = std::max(peak, buffer.offset + buffer.bytes);
+        }
+        return peak;
+    }
+
+    size_t naiveBytes() const {
+        size_t total = 0;
+        for (const Buffer& buffer : buffers) {
+            total += buffer.bytes;
+        }
+        return total;
+    }
+
+    size_t liveBound() const {
+        size_t bound = 0;
+        for (const Buffer& at : buffers) {
+            // The maximum of live bytes is reached at the start of some buffer's lifetime
+            size_t live = 0;
+            for (const Buffer& buffer : buffers) {
+                if (buffer.first <= at.first && at.first <= buffer.last) {
+                    live += buffer.bytes;
+                }
+            }
+            bound = std::max(bound, live);
+        }
+        return bound;
+    }
+
+    const std::vector<Buffer>& getBuffers() const {
+        return buffers;
+    }
+
+    void print(std::ostream& out = std::cout) const {
+        out << "Memory plan: " << buffers.size() << " buffer(s)" << std::endl;
+        for (const Buffer& buffer : buffers) {
+            out << "  " << buffer.name << ": " << buffer.bytes << " bytes at " << buffer.offset
+                << ", steps " << buffer.first << "-" << buffer.last << std::endl;
+        }
+        out << "Planned peak: " << peakBytes() << " bytes, naive: " << naiveBytes() << " bytes, lower bound: "
+            << liveBound() << " bytes" << std::endl;
+    }
+
+private:
+    static const size_t alignment = 64;
+    std::vector<Buffer> buffers;
+};
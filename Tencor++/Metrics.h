@@ -0,0 +1,222 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+enum class ReportMode {
+    Console,
+    Silent,
+    JsonLines
+};
+
+// Training progress for fit. Training threads only add to atomic counters (record() takes no lock and
+// does no I/O); a render thread turns them into output every interval: one progress line rewritten in
+// place on the console, or one JSON object per line on a sink such as a log file. Epoch summaries and
+// notes are written when they happen. Silent mode starts no thread and writes nothing.
+//
+// Counters are read and reset one at a time, so a step recorded during a render may land in the next
+// interval; totals are never lost.
+class MetricsReporter {
+public:
+    using Fields = std::vector<std::pair<std::string, double>>;
+
+    MetricsReporter(ReportMode mode = ReportMode::Console, double intervalSeconds = 0.5, std::ostream* sink = nullptr)
+        : mode(mode), interval(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(intervalSeconds))),
+          out(sink != nullptr ? *sink : std::cout), stopping(false), epoch(0), epochs(0), totalSamples(0), doneSamples(0),
+          intervalSteps(0), intervalSamples(0), intervalNanos(0), maxNanos(0), intervalLoss(0.0), inEpoch(false), lineOpen(false),
+          loss(0.0), samplesPerSecond(0.0), stepMilliseconds(0.0), maxStepMilliseconds(0.0) {
+        if (mode != ReportMode::Silent) {
+            renderer = std::thread([this] { renderLoop(); });
+        }
+    }
+
+    ~MetricsReporter() {
+        if (renderer.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(wakeMutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            renderer.join();
+        }
+    }
+
+    MetricsReporter(const MetricsReporter&) = delete;
+    MetricsReporter& operator=(const MetricsReporter&) = delete;
+
+    void beginEpoch(int epoch, int epochs, int samples) {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        this->epoch = epoch;
+        this->epochs = epochs;
+        totalSamples = samples;
+        doneSamples.store(0);
+        epochStart = lastRender = std::chrono::steady_clock::now();
+        inEpoch = true;
+    }
+
+    // One training step of samples columns; safe to call from any number of threads at once
+    void record(int samples, double stepLoss, double seconds) {
+        const long long nanos = static_cast<long long>(seconds * 1e9);
+        doneSamples.fetch_add(samples, std::memory_order_relaxed);
+        intervalSteps.fetch_add(1, std::memory_order_relaxed);
+        intervalSamples.fetch_add(samples, std::memory_order_relaxed);
+        intervalNanos.fetch_add(nanos, std::memory_order_relaxed);
+        double sum = intervalLoss.load(std::memory_order_relaxed);
+        while (!intervalLoss.compare_exchange_weak(sum, sum + stepLoss, std::memory_order_relaxed)) {
+        }
+        long long longest = maxNanos.load(std::memory_order_relaxed);
+        while (nanos > longest && !maxNanos.compare_exchange_weak(longest, nanos, std::memory_order_relaxed)) {
+        }
+    }
+
+    void endEpoch(double epochLoss) {
+        if (mode == ReportMode::Silent) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(outputMutex);
+        render();
+        inEpoch = false;
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - epochStart).count();
+        if (mode == ReportMode::Console) {
+            closeLine();
+            out << "Epoch: " << epoch + 1 << " Epoch Loss: " << epochLoss << std::endl << std::endl;
+            return;
+        }
+        writeJson("epoch", { { "epoch", static_cast<double>(epoch + 1) }, { "loss", epochLoss }, { "seconds", seconds },
+                             { "samples_per_sec", seconds > 0.0 ? totalSamples / seconds : 0.0 } });
+    }
+
+    // An event outside the step loop: text for the console, fields for the JSON sink
+    void note(const std::string& event, const std::string& text, const Fields& fields = Fields()) {
+        if (mode == ReportMode::Silent) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(outputMutex);
+        if (mode == ReportMode::Console) {
+            closeLine();
+            out << text << std::endl;
+            return;
+        }
+        writeJson(event, fields);
+    }
+
+private:
+    const ReportMode mode;
+    const std::chrono::steady_clock::duration interval;
+    std::ostream& out;
+    std::thread renderer;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    bool stopping;
+
+    // Written by the training thread between epochs, under outputMutex
+    int epoch;
+    int epochs;
+    int totalSamples;
+    std::chrono::steady_clock::time_point epochStart;
+
+    // Hot-path counters
+    std::atomic<long long> doneSamples;
+    std::atomic<long long> intervalSteps;
+    std::atomic<long long> intervalSamples;
+    std::atomic<long long> intervalNanos;
+    std::atomic<long long> maxNanos;
+    std::atomic<double> intervalLoss;
+
+    // Render state, under outputMutex
+    std::mutex outputMutex;
+    bool inEpoch;
+    bool lineOpen;
+    std::chrono::steady_clock::time_point lastRender;
+    double loss;
+    double samplesPerSecond;
+    double stepMilliseconds;
+    double maxStepMilliseconds;
+
+    void renderLoop() {
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        while (!wake.wait_for(lock, interval, [this] { return stopping; })) {
+            lock.unlock();
+            {
+                std::lock_guard<std::mutex> output(outputMutex);
+                if (inEpoch) {
+                    render();
+                }
+            }
+            lock.lock();
+        }
+    }
+
+    // Folds the interval's counters into the shown figures; intervals without steps keep the last ones
+    void render() {
+        const auto now = std::chrono::steady_clock::now();
+        const double elapsed = std::chrono::duration<double>(now - lastRender).count();
+        lastRender = now;
+        const long long steps = intervalSteps.exchange(0, std::memory_order_relaxed);
+        const long long samples = intervalSamples.exchange(0, std::memory_order_relaxed);
+        const long long nanos = intervalNanos.exchange(0, std::memory_order_relaxed);
+        const long long longest = maxNanos.exchange(0, std::memory_order_relaxed);
+        const double lossSum = intervalLoss.exchange(0.0, std::memory_order_relaxed);
+        if (steps > 0) {
+            loss = lossSum / steps;
+            samplesPerSecond = elapsed > 0.0 ? samples / elapsed : 0.0;
+            stepMilliseconds = nanos / 1e6 / steps;
+            maxStepMilliseconds = longest / 1e6;
+        }
+        const long long done = std::min<long long>(doneSamples.load(std::memory_order_relaxed), totalSamples);
+
+        if (mode == ReportMode::JsonLines) {
+            if (steps > 0) {
+                writeJson("progress", { { "epoch", static_cast<double>(epoch + 1) }, { "samples", static_cast<double>(done) }, { "total", static_cast<double>(totalSamples) },
+                                        { "loss", loss }, { "samples_per_sec", samplesPerSecond }, { "step_ms", stepMilliseconds },
+                                        { "max_step_ms", maxStepMilliseconds } });
+            }
+            return;
+        }
+
+        // Built first and written in one go, then flushed once per interval
+        const int barWidth = 50;
+        const double progress = totalSamples > 0 ? static_cast<double>(done) / totalSamples : 1.0;
+        const int filled = static_cast<int>(progress * barWidth);
+        std::ostringstream line;
+        line << "\rEpoch [" << epoch + 1 << "/" << epochs << "] Samples [" << done << "/" << totalSamples << "] ["
+             << std::string(filled, '=') << std::string(barWidth - filled, ' ') << "] " << static_cast<int>(progress * 100)
+             << "% Loss: " << loss << " | " << static_cast<long long>(samplesPerSecond) << " samples/s | "
+             << stepMilliseconds << " ms/step";
+        out << line.str() << std::flush;
+        lineOpen = true;
+    }
+
+    void closeLine() {
+        if (lineOpen) {
+            out << '\n';
+            lineOpen = false;
+        }
+    }
+
+    // NaN and infinity have no JSON spelling and are written as null
+    void writeJson(const std::string& event, const Fields& fields) {
+        std::ostringstream line;
+        line << "{\"event\":\"" << event << "\"";
+        for (const std::pair<std::string, double>& field : fields) {
+            line << ",\"" << field.first << "\":";
+            if (std::isfinite(field.second)) {
+                line << field.second;
+            }
+            else {
+                line << "null";
+            }
+        }
+        line << "}\n";
+        out << line.str() << std::flush;
+    }
+};
@@ -1,19 +1,119 @@
 #pragma once
 #include <iostream>
 #include <string>
-#include "Stack.h"
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <limits>
+#include <sstream>
+#include "Autograd.h"
 #include "Loss.h"
 #include "Layer.h"
 #include "Hash.h"
+#include "Fusion.h"
+#include "Optimizer.h"
+#include "ThreadPool.h"
+#include "Prefetcher.h"
+#include "Precision.h"
+#include "Metrics.h"
+
+// Optional settings for Model::fit
+struct TrainingOptions {
+    // Worker threads for synchronous data-parallel steps; 1 trains on the calling thread
+    int threads = 1;
+    // Hogwild: with threads > 1, workers train on whole minibatches independently and write plain SGD
+    // updates into the shared weights without locks. The compiled optimizer is not used.
+    bool asynchronous = false;
+    // Micro-batches of batchSize samples whose gradients are combined into one update, so the
+    // effective batch is batchSize * accumulationSteps while activations only ever hold batchSize.
+    // With a mean-reduced loss each micro-batch's gradient is weighted by its share of the group's
+    // samples, so the update matches one step over the whole group, including the shorter last
+    // group of an epoch.
+    int accumulationSteps = 1;
+    // Pipeline parallelism: consecutive layers are split over this many threads and every batch flows
+    // through them as pipelineMicroBatches micro-batches. Not combined with threads > 1.
+    int pipelineStages = 1;
+    int pipelineMicroBatches = 4;
+    // Off by default, so the samples are visited in their stored order. When set, each epoch visits
+    // them in a fresh random order. Only an index array is permuted; batches are gathered from it, so
+    // the dataset itself is never reordered or copied. Runs repeat per seed.
+    bool shuffle = false;
+    uint32_t shuffleSeed = 0;
+    // Batches a background thread keeps ready ahead of the one training. The default 0 slices each
+    // batch on the training thread, and 1 double-buffers. Hogwild workers always slice their own batches.
+    int prefetchDepth = 0;
+    // Optional per-batch preparation (normalization, one-hot, layout), run on the prefetch thread, or
+    // on the training thread when there is none
+    BatchPrefetcher::Prepare prepareBatch;
+    // Mixed precision: layers that support it compute in float and cache bfloat16 activations while
+    // the weights stay in double; the loss is scaled dynamically and steps whose gradients overflow
+    // are skipped. Not available to Hogwild, which bypasses the optimizer.
+    bool mixedPrecision = false;
+    double initialLossScale = 65536.0;
+    int lossScaleGrowthInterval = 2000;
+    // Held-out data scored after every epoch. Scoring runs on a snapshot of the weights in a background
+    // thread while the next epoch trains, so its results arrive one epoch late. Both tensors must
+    // outlive fit.
+    const Tensor2<double>* validationInput = nullptr;
+    const Tensor2<double>* validationTarget = nullptr;
+    // Stop once validation loss has gone this many epochs without improving by more than
+    // earlyStoppingMinDelta (0 never stops), then load the weights of the best epoch back if
+    // restoreBestWeights is set
+    int earlyStoppingPatience = 0;
+    double earlyStoppingMinDelta = 0.0;
+    bool restoreBestWeights = true;
+    // Progress output: a console line redrawn every reportInterval seconds, nothing, or JSON lines
+    // written to metricsSink (std::cout when null), which must outlive fit
+    ReportMode reporting = ReportMode::Console;
+    double reportInterval = 0.5;
+    std::ostream* metricsSink = nullptr;
+};
+
+// What the chunked Model::predict writes per sample (one column each)
+enum class PredictOutput {
+    Scores,     // the model's output rows, probabilities after a softmax
+    Classes,    // one row: the index of the highest score
+    TopK        // topK rows: class indices, best first
+};
+
+// Optional settings for the chunked Model::predict
+struct PredictOptions {
+    int threads = 1;
+    // Runs the chunks on this pool instead of the model's own, and its size replaces threads. It must
+    // not be running anything else meanwhile.
+    ThreadPool* pool = nullptr;
+    PredictOutput output = PredictOutput::Scores;
+    int topK = 5;
+    // Activation budget per chunk when no batch size is given, about one core's L2
+    size_t cacheBytes = 1 << 20;
+};
+
+// Validation metrics of one epoch; accuracy is NaN unless targets are one-hot (more than one row)
+struct ValidationResult {
+    int epoch;
+    double loss;
+    double accuracy;
+};
 
 class Model {
 private:
 	HashTable<Layer*> layers;
     Loss<double>* lossFunc;
+    Optimizer* optimizer;
+    SGD defaultOptimizer;
     int layerCount;
+    // Workers for the chunked predict, created by its first multithreaded call
+    mutable std::mutex predictPoolMutex;
+    mutable std::unique_ptr<ThreadPool> predictPool;
 
 public:
-    Model() : lossFunc(nullptr), layerCount(0) {} // Initialize layerCount to 0 and lossFunc to nullptr
+    Model() : lossFunc(nullptr), optimizer(&defaultOptimizer), layerCount(0) {} // Initialize layerCount to 0 and lossFunc to nullptr
+    virtual ~Model() {}
 
     void addLayer(std::string name, Layer* layer) {
 		layers.put(name, layer);
@@ -27,40 +127,155 @@ public:
         addLayer("layer " + std::to_string(layerCount), layer);
         layer->setModel(this);
     }
+    void removeLayer(Layer* layer) {
+        for (const std::string& key : layers.getKeys()) {
+            if (layers.get(key) == layer) {
+                layers.remove(key);
+                return;
+            }
+        }
+    }
     virtual Tensor2<double> forward(Tensor2<double> input, bool training = false) = 0;
+    // Tape-free inference, safe to call on a const model, and from several threads at once as long
+    // as nothing trains or changes the weights meanwhile
+    virtual Tensor2<double> predict(const Tensor2<double>& input) const = 0;
+    // Class index per column; models may skip the final softmax since it does not change the argmax
+    virtual Tensor2<double> predictClasses(const Tensor2<double>& input) const {
+        return Tensor2<double>::argmax(predict(input), 0);
+    }
+    // Scores before a final softmax, which ranks classes the same; models without one return predict
+    virtual Tensor2<double> predictLogits(const Tensor2<double>& input) const {
+        return predict(input);
+    }
+    // Columns per chunk whose inference activations fit in cacheBytes. Without knowing the layer
+    // widths, this assumes every activation is as wide as the input.
+    virtual int inferenceBatchSize(int inputSize, size_t cacheBytes) const {
+        const size_t perColumn = 2 * sizeof(double) * static_cast<size_t>(std::max(inputSize, 1));
+        return static_cast<int>(std::max<size_t>(1, std::min<size_t>(cacheBytes / perColumn, std::numeric_limits<int>::max())));
+    }
 
-    void backward(Tensor2<double> grad, double learningRate) {
-        while (!forwardStack.isEmpty()) {
-            Layer* layer = forwardStack.pop();
-            grad = layer->backward(grad, learningRate);
+    // Inference over many samples in chunks of batchSize columns (inferenceBatchSize when batchSize
+    // <= 0), spread over options.threads threads. Nothing is recorded on the tape, and every chunk
+    // writes its columns straight into one result allocated up front. Classes and TopK rank the
+    // logits, so probabilities are never materialized. The threads come from options.pool or else
+    // from a pool the model keeps between calls; a call that finds the model's pool busy with
+    // another thread's predict runs its chunks on the calling thread alone.
+    Tensor2<double> predict(const Tensor2<double>& input, int batchSize, const PredictOptions& options = PredictOptions()) const {
+        const int samples = input.getShape()[1];
+        if (samples == 0) {
+            std::cerr << "Input must hold at least one sample" << std::endl;
+            throw std::invalid_argument("Input must hold at least one sample");
+        }
+        if (options.threads <= 0 || options.topK <= 0) {
+            std::cerr << "Thread count and top-k must be greater than 0" << std::endl;
+            throw std::invalid_argument("Thread count and top-k must be greater than 0");
+        }
+        if (batchSize <= 0) {
+            batchSize = inferenceBatchSize(input.getShape()[0], options.cacheBytes);
+        }
+        batchSize = std::min(batchSize, samples);
+        const int chunks = (samples + batchSize - 1) / batchSize;
+
+        auto runChunk = [&](int chunk) {
+            const int start = chunk * batchSize;
+            Tensor2<double> part = input.slice(start, std::min(start + batchSize, samples), 1);
+            switch (options.output) {
+            case PredictOutput::Classes:
+                return predictClasses(part);
+            case PredictOutput::TopK:
+                return topClasses(predictLogits(part), options.topK);
+            default:
+                return predict(part);
+            }
+        };
+
+        // The first chunk tells how many rows the result has
+        Tensor2<double> first = runChunk(0);
+        Tensor2<double> result({ first.getShape()[0], samples });
+        copyColumnsInto(result, first, 0);
+        if (chunks == 1) {
+            return result;
+        }
+        auto runRest = [&](int task) {
+            copyColumnsInto(result, runChunk(task + 1), (task + 1) * batchSize);
+        };
+        if (options.pool != nullptr) {
+            options.pool->run(chunks - 1, runRest);
+            return result;
+        }
+        std::unique_lock<std::mutex> lock(predictPoolMutex, std::try_to_lock);
+        if (options.threads == 1 || !lock.owns_lock()) {
+            for (int task = 0; task < chunks - 1; ++task) {
+                runRest(task);
+            }
+            return result;
+        }
+        if (!predictPool || predictPool->size() != options.threads) {
+            predictPool.reset(new ThreadPool(options.threads));
         }
+        predictPool->run(chunks - 1, runRest);
+        return result;
+    }
+    // Rewrites the layer graph into fused layers. Training-safe patterns always apply; inference-only
+    // ones (those that bake in running statistics) only when inference is set.
+    virtual FusionReport fuseLayers(bool /*inference*/) {
+        return FusionReport();
+    }
+    // Independent copy with the same weights but its own caches and tape, for worker `index`. With
+    // sharedParameters the copy's parameters may be left unallocated, for shareParameters to fill in.
+    // Models that cannot be replicated return nullptr.
+    virtual Model* replicate(int /*index*/, bool /*sharedParameters*/ = false) const {
+        return nullptr;
+    }
+    // Forward and backward for one batch on pool's threads, one pipeline stage per thread. Gradients
+    // accumulate in the layers as usual, weighted as a slice of groupColumns columns (the batch's own
+    // when 0) under a mean-reduced loss; returns the loss. Models without stages do not support it.
+    virtual double pipelineStep(ThreadPool& /*pool*/, Loss<double>& /*loss*/, const Tensor2<double>& /*batchInput*/,
+                                const Tensor2<double>& /*batchTarget*/, int /*stages*/, int /*microBatches*/, int /*groupColumns*/ = 0) {
+        std::cerr << "This model does not support pipelined training" << std::endl;
+        throw std::invalid_argument("This model does not support pipelined training");
+    }
+
+    // Every trainable tensor of every layer, in the order the layers were added
+    std::vector<Parameter> parameters() {
+        std::vector<Parameter> result;
+        for (const std::string& key : layers.getKeys()) {
+            std::vector<Parameter> layerParameters = layers.get(key)->parameters();
+            result.insert(result.end(), layerParameters.begin(), layerParameters.end());
+        }
+        return result;
     }
-    void printProgress(int epoch, int epochs, int batch, int total, double loss, bool endOfEpoch = false) {
-        int progressBarWidth = 50; // Width of the progress bar
-        float progress = static_cast<float>(batch) / total; // Calculate progress
-        int pos = static_cast<int>(progress * progressBarWidth); // Calculate position in the bar
 
-        std::cout << "\rEpoch [" << epoch + 1 << "/" << epochs << "] "
-            << "Batch [" << batch << "/" << total << "] "
-            << "[";
-        for (int i = 0; i < progressBarWidth; ++i) {
-            if (i < pos) std::cout << "="; // Filled part
-            else std::cout << " "; // Empty part
+    std::vector<Tensor2<double>*> buffers() {
+        std::vector<Tensor2<double>*> result;
+        for (const std::string& key : layers.getKeys()) {
+            std::vector<Tensor2<double>*> layerBuffers = layers.get(key)->buffers();
+            result.insert(result.end(), layerBuffers.begin(), layerBuffers.end());
         }
-        std::cout << "] " << int(progress * 100) << "% "
-            << "Loss: " << loss << std::flush; // Print loss
+        return result;
+    }
 
-        if (endOfEpoch) {
-            std::cout << std::endl; // Print a newline at the end of the epoch
+    // Runs the tape backwards, accumulating gradients without applying them; returns the input gradient
+    Tensor2<double> backpropagate(Tensor2<double> grad) {
+        while (!forwardStack.isEmpty()) {
+            Layer* layer = forwardStack.pop();
+            grad = layer->backward(grad);
         }
-        std::cout.flush(); // Ensure the output is displayed immediately
+        return grad;
+    }
+
+    void backward(Tensor2<double> grad, double learningRate) {
+        backpropagate(std::move(grad));
+        applyGradients(learningRate);
     }
 
-    void printEpochDetails(int epoch, int epochs, double loss) {
-        std::cout << "\rEpoch: " << epoch + 1 << " Epoch Loss: " << loss << std::endl << std::endl; // Print loss
-        std::cout.flush(); // Ensure the output is displayed immediately
+    // One optimizer step over whatever gradients have accumulated since the last one
+    void applyGradients(double learningRate) {
+        std::vector<Parameter> params = parameters();
+        optimizer->step(params, learningRate);
     }
-    void fit(Tensor2<double> input, Tensor2<double> target, int epochs, double learningRate, int batchSize = -1) {
+    void fit(Tensor2<double> input, Tensor2<double> target, int epochs, double learningRate, int batchSize = -1,
+             const TrainingOptions& options = TrainingOptions()) {
         if (batchSize == -1) {
             batchSize = input.getShape()[1];
         } else if (batchSize > input.getShape()[1]) {
@@ -76,38 +291,672 @@ public:
             throw std::invalid_argument("Loss function not set");
         }
 
+        if (options.threads <= 0) {
+            std::cerr << "Thread count must be greater than 0" << std::endl;
+            throw std::invalid_argument("Thread count must be greater than 0");
+        }
+        if (options.accumulationSteps <= 0) {
+            std::cerr << "Accumulation steps must be greater than 0" << std::endl;
+            throw std::invalid_argument("Accumulation steps must be greater than 0");
+        }
+        if (options.pipelineStages <= 0 || options.pipelineMicroBatches <= 0) {
+            std::cerr << "Pipeline stages and micro-batches must be greater than 0" << std::endl;
+            throw std::invalid_argument("Pipeline stages and micro-batches must be greater than 0");
+        }
+        if (options.prefetchDepth < 0) {
+            std::cerr << "Prefetch depth cannot be negative" << std::endl;
+            throw std::invalid_argument("Prefetch depth cannot be negative");
+        }
+        if (options.mixedPrecision && options.asynchronous && options.threads > 1) {
+            std::cerr << "Mixed precision is not supported with asynchronous training" << std::endl;
+            throw std::invalid_argument("Mixed precision is not supported with asynchronous training");
+        }
+        if (options.pipelineStages > 1 && options.threads > 1) {
+            std::cerr << "Pipeline and data-parallel training cannot be combined" << std::endl;
+            throw std::invalid_argument("Pipeline and data-parallel training cannot be combined");
+        }
+        if ((options.validationInput == nullptr) != (options.validationTarget == nullptr) ||
+            (options.validationInput != nullptr && options.validationInput->getShape()[1] != options.validationTarget->getShape()[1])) {
+            std::cerr << "Validation input and target must be given together, with one column per sample" << std::endl;
+            throw std::invalid_argument("Validation input and target must be given together, with one column per sample");
+        }
+        if (options.reportInterval <= 0.0) {
+            std::cerr << "Report interval must be greater than 0" << std::endl;
+            throw std::invalid_argument("Report interval must be greater than 0");
+        }
+        if (options.earlyStoppingPatience < 0) {
+            std::cerr << "Early stopping patience cannot be negative" << std::endl;
+            throw std::invalid_argument("Early stopping patience cannot be negative");
+        }
+
+        const int samples = input.getShape()[1];
+        const int totalBatches = (samples + batchSize - 1) / batchSize;
+
+        MetricsReporter reporter(options.reporting, options.reportInterval, options.metricsSink);
+
+        // Scores with the unscaled loss, so it is made before mixed precision swaps lossFunc
+        validationHistory.clear();
+        std::unique_ptr<Validator> validator;
+        if (options.validationInput != nullptr) {
+            validator.reset(new Validator(*this, *lossFunc, reporter, options, batchSize));
+        }
+
+        // Before replicas are made, so they clone the layers in the same mode
+        std::unique_ptr<LossScaler> scaler;
+        MixedPrecisionScope precisionScope(*this, options.mixedPrecision);
+        if (options.mixedPrecision) {
+            scaler.reset(new LossScaler(*lossFunc, options.initialLossScale, options.lossScaleGrowthInterval));
+            lossFunc = scaler.get();
+        }
+
+        std::unique_ptr<ThreadPool> pool;
+        std::vector<std::unique_ptr<Model>> replicas;
+        if (options.pipelineStages > 1) {
+            pool.reset(new ThreadPool(options.pipelineStages));
+        }
+        if (options.threads > 1) {
+            pool.reset(new ThreadPool(options.threads));
+            for (int t = 0; t < options.threads; ++t) {
+                Model* replica = replicate(t, true);
+                if (replica == nullptr) {
+                    std::cerr << "This model does not support multithreaded training" << std::endl;
+                    throw std::invalid_argument("This model does not support multithreaded training");
+                }
+                replicas.emplace_back(replica);
+                shareParameters(*replica);
+            }
+        }
+        std::unique_ptr<BatchPrefetcher> prefetcher;
+        if (options.prefetchDepth > 0 && !(options.asynchronous && !replicas.empty())) {
+            prefetcher.reset(new BatchPrefetcher(input, target, batchSize, epochs, options.prefetchDepth, options.shuffle,
+                                                options.shuffleSeed, options.prepareBatch));
+        }
+        inputStallSeconds = 0.0;
+
         for (int i = 0; i < epochs; i++) {
+            std::vector<int> order;
+            if (!prefetcher) {
+                order = epochOrder(samples, options.shuffle, options.shuffleSeed, i);
+            }
+            reporter.beginEpoch(i, epochs, samples);
+            if (options.asynchronous && !replicas.empty()) {
+                double avgLoss = asynchronousEpoch(*pool, replicas, input, target, order, batchSize, options.accumulationSteps, learningRate, reporter);
+                reporter.endEpoch(avgLoss);
+                if (validator && validator->epochFinished(i)) {
+                    break;
+                }
+                continue;
+            }
+
             double overallLoss = 0.0;
-            for (int j = 0; j < input.getShape()[1]; j += batchSize) {
-                Tensor2<double> output = forward(input.slice(j, j + batchSize, 1), true);
-                Tensor2<double> grad = lossFunc->backward(output, target.slice(j, j + batchSize, 1));
-                double loss = lossFunc->forward(output, target.slice(j, j + batchSize, 1));
-                backward(grad, learningRate);
-                printProgress(i, epochs, j, input.getShape()[1], loss);
+            int pendingSteps = 0;
+            auto epochStart = std::chrono::steady_clock::now();
+            // Reused across batches when this thread assembles them itself
+            Tensor2<double> slicedInput;
+            Tensor2<double> slicedTarget;
+            for (int j = 0; j < samples; j += batchSize) {
+                int end = std::min(j + batchSize, samples);
+                auto stepStart = std::chrono::steady_clock::now();
+                BatchPrefetcher::Batch* batch = nullptr;
+                if (prefetcher) {
+                    batch = prefetcher->next();
+                }
+                else {
+                    if (order.empty()) {
+                        slicedInput = input.slice(j, end, 1);
+                        slicedTarget = target.slice(j, end, 1);
+                    }
+                    else {
+                        input.gatherColumns(order, j, end, slicedInput);
+                        target.gatherColumns(order, j, end, slicedTarget);
+                    }
+                    if (options.prepareBatch) {
+                        options.prepareBatch(slicedInput, slicedTarget);
+                    }
+                }
+                const Tensor2<double>& batchInput = batch != nullptr ? batch->input : slicedInput;
+                const Tensor2<double>& batchTarget = batch != nullptr ? batch->target : slicedTarget;
+                // Columns of the accumulation group this batch belongs to
+                const int groupStart = j - pendingSteps * batchSize;
+                const int groupColumns = std::min(groupStart + options.accumulationSteps * batchSize, samples) - groupStart;
+                double loss;
+                if (options.pipelineStages > 1) {
+                    loss = pipelineStep(*pool, *lossFunc, batchInput, batchTarget, options.pipelineStages, options.pipelineMicroBatches, groupColumns);
+                }
+                else if (!replicas.empty()) {
+                    loss = parallelStep(*pool, replicas, batchInput, batchTarget, groupColumns);
+                }
+                else {
+                    loss = accumulateStep(batchInput, batchTarget, groupColumns);
+                }
+                if (batch != nullptr) {
+                    prefetcher->release(batch);
+                }
+                // The last group of an epoch may be short; it is applied rather than carried over
+                if (++pendingSteps == options.accumulationSteps || end == samples) {
+                    std::vector<Parameter> params = parameters();
+                    if (scaler == nullptr || scaler->unscale(params)) {
+                        optimizer->step(params, learningRate);
+                    }
+                    pendingSteps = 0;
+                }
+                reporter.record(end - j, loss, std::chrono::duration<double>(std::chrono::steady_clock::now() - stepStart).count());
                 overallLoss += loss;
             }
-            // Run the remaining samples
-            if (input.getShape()[1] % batchSize != 0) {
-                Tensor2<double> output = forward(input.slice(input.getShape()[1] - (input.getShape()[1] % batchSize), input.getShape()[1], 1), true);
-                Tensor2<double> grad = lossFunc->backward(output, target.slice(input.getShape()[1] - (input.getShape()[1] % batchSize), input.getShape()[1], 1));
-                backward(grad, learningRate);
-                double loss = lossFunc->forward(output, target.slice(input.getShape()[1] - (input.getShape()[1] % batchSize), input.getShape()[1], 1));
-                printProgress(i, epochs, input.getShape()[1], input.getShape()[1], loss);
-                overallLoss += loss;
+            double avgLoss = overallLoss / totalBatches;
+            reporter.endEpoch(avgLoss);
+            if (scaler) {
+                std::ostringstream text;
+                text << "Loss scale: " << scaler->getScale() << " (" << scaler->getSkippedSteps() << " overflowing steps skipped)";
+                reporter.note("loss_scale", text.str(), { { "epoch", i + 1.0 }, { "scale", scaler->getScale() }, { "skipped", static_cast<double>(scaler->getSkippedSteps()) } });
             }
-            int totalBatches = input.getShape()[1] / batchSize;
-            if (input.getShape()[1] % batchSize != 0) {
-                totalBatches++;
+            if (prefetcher) {
+                double stall = prefetcher->takeStallSeconds();
+                double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - epochStart).count();
+                double share = elapsed > 0.0 ? 100.0 * stall / elapsed : 0.0;
+                inputStallSeconds += stall;
+                std::ostringstream text;
+                text << "Input stall: " << stall * 1000.0 << " ms (" << share << "% of epoch)" << std::endl;
+                reporter.note("input_stall", text.str(),
+                              { { "epoch", i + 1.0 }, { "stall_ms", stall * 1000.0 }, { "percent", share } });
             }
-            double avgLoss = overallLoss / totalBatches;
-            printProgress(i, epochs, input.getShape()[1], input.getShape()[1], avgLoss, true); // End of epoch
-            printEpochDetails(i, epochs, avgLoss);
+            if (validator && validator->epochFinished(i)) {
+                break;
+            }
+        }
+        if (validator) {
+            validator->finish();
         }
     }
 
-    void compile(Loss<double>* loss) {
+    // Time the last fit spent waiting for prefetched batches; near zero when preparation is hidden
+    double getInputStallSeconds() const {
+        return inputStallSeconds;
+    }
+
+    // Validation metrics of the last fit, one entry per scored epoch
+    const std::vector<ValidationResult>& getValidationHistory() const {
+        return validationHistory;
+    }
+
+    // Without an optimizer the model trains with plain SGD at fit's learning rate
+    void compile(Loss<double>* loss, Optimizer* optimizer = nullptr, bool fuse = true) {
         lossFunc = loss;
+        this->optimizer = optimizer != nullptr ? optimizer : &defaultOptimizer;
+        if (fuse) {
+            fuseLayers(false);
+        }
+    }
+
+    // Every fusion applied so far, by compile or by later fuseLayers(true) calls
+    const FusionReport& getFusionReport() const {
+        return fusionReport;
+    }
+
+    Tape<Layer*> forwardStack;
+
+private:
+    // Switches the layers to mixed precision for one fit and restores the training loss and the layers
+    // on the way out, also when fit throws
+    class MixedPrecisionScope {
+    public:
+        MixedPrecisionScope(Model& model, bool enabled) : model(model), enabled(enabled), loss(model.lossFunc) {
+            if (enabled) {
+                model.setMixedPrecision(true);
+            }
+        }
+
+        ~MixedPrecisionScope() {
+            if (enabled) {
+                model.lossFunc = loss;
+                model.setMixedPrecision(false);
+            }
+        }
+
+    private:
+        Model& model;
+        bool enabled;
+        Loss<double>* loss;
+    };
+
+    // Scores each epoch on a replica holding a snapshot of the weights, on its own thread. Training
+    // only waits when an evaluation takes longer than the epoch after it. The snapshot is refreshed
+    // in place once the previous result is in, and the best epoch's weights are kept for restoring.
+    class Validator {
+    public:
+        Validator(Model& model, Loss<double>& loss, MetricsReporter& reporter, const TrainingOptions& options, int batchSize)
+            : model(model), loss(loss), reporter(reporter), input(*options.validationInput), target(*options.validationTarget), batchSize(batchSize),
+              patience(options.earlyStoppingPatience), minDelta(options.earlyStoppingMinDelta), restoreBest(options.restoreBestWeights),
+              bestLoss(std::numeric_limits<double>::infinity()), bestEpoch(-1) {
+            snapshot.reset(model.replicate(0));
+            if (snapshot == nullptr) {
+                std::cerr << "This model does not support background validation" << std::endl;
+                throw std::invalid_argument("This model does not support background validation");
+            }
+        }
+
+        // Waits for a running evaluation; it only reads the snapshot and the validation data
+        ~Validator() {
+            if (pending.valid()) {
+                pending.wait();
+            }
+        }
+
+        // After epoch's update: collects the previous epoch's result and starts scoring this one.
+        // Returns true when early stopping says to end training.
+        bool epochFinished(int epoch) {
+            if (pending.valid() && record(pending.get())) {
+                return true;
+            }
+            snapshotWeights();
+            pending = std::async(std::launch::async, [this, epoch] { return evaluate(epoch); });
+            return false;
+        }
+
+        // Collects the last result and, with early stopping, restores the best epoch's weights
+        void finish() {
+            if (pending.valid()) {
+                record(pending.get());
+            }
+            if (patience == 0 || !restoreBest || bestEpoch < 0 || bestEpoch == model.validationHistory.back().epoch) {
+                return;
+            }
+            std::vector<Parameter> params = model.parameters();
+            std::vector<Tensor2<double>*> state = model.buffers();
+            for (size_t i = 0; i < params.size(); ++i) {
+                copyRows(*params[i].value, best[i]);
+            }
+            for (size_t i = 0; i < state.size(); ++i) {
+                copyRows(*state[i], best[params.size() + i]);
+            }
+            reporter.note("restore", "Restored weights from epoch " + std::to_string(bestEpoch + 1) + "\n", { { "epoch", bestEpoch + 1.0 } });
+        }
+
+    private:
+        Model& model;
+        Loss<double>& loss;
+        MetricsReporter& reporter;
+        const Tensor2<double>& input;
+        const Tensor2<double>& target;
+        const int batchSize;
+        const int patience;
+        const double minDelta;
+        const bool restoreBest;
+        std::unique_ptr<Model> snapshot;
+        std::future<ValidationResult> pending;
+        // Parameter values, then buffers, of the best epoch so far
+        std::vector<Tensor2<double>> best;
+        double bestLoss;
+        int bestEpoch;
+
+        void snapshotWeights() {
+            std::vector<Parameter> params = model.parameters();
+            std::vector<Parameter> local = snapshot->parameters();
+            std::vector<Tensor2<double>*> state = model.buffers();
+            std::vector<Tensor2<double>*> localState = snapshot->buffers();
+            for (size_t i = 0; i < params.size(); ++i) {
+                copyRows(*local[i].value, *params[i].value);
+            }
+            for (size_t i = 0; i < state.size(); ++i) {
+                copyRows(*localState[i], *state[i]);
+            }
+        }
+
+        // Runs on the background thread, in chunks of batchSize so memory stays at one batch
+        ValidationResult evaluate(int epoch) const {
+            const int samples = input.getShape()[1];
+            const int classes = target.getShape()[0];
+            double lossSum = 0.0;
+            int correct = 0;
+            for (int start = 0; start < samples; start += batchSize) {
+                const int end = std::min(start + batchSize, samples);
+                Tensor2<double> chunkTarget = target.slice(start, end, 1);
+                Tensor2<double> prediction = snapshot->predict(input.slice(start, end, 1));
+                lossSum += loss.forward(prediction, chunkTarget) * (end - start);
+                if (classes > 1) {
+                    correct += countCorrect(prediction, chunkTarget);
+                }
+            }
+            return { epoch, lossSum / samples, classes > 1 ? static_cast<double>(correct) / samples : std::numeric_limits<double>::quiet_NaN() };
+        }
+
+        static int countCorrect(const Tensor2<double>& prediction, const Tensor2<double>& target) {
+            const int rows = target.getShape()[0];
+            const int cols = target.getShape()[1];
+            int correct = 0;
+            for (int j = 0; j < cols; ++j) {
+                int predicted = 0;
+                int actual = 0;
+                for (int i = 1; i < rows; ++i) {
+                    if (prediction[i][j] > prediction[predicted][j]) {
+                        predicted = i;
+                    }
+                    if (target[i][j] > target[actual][j]) {
+                        actual = i;
+                    }
+                }
+                correct += predicted == actual;
+            }
+            return correct;
+        }
+
+        // Returns true when the epochs since the best one have used up the patience
+        bool record(const ValidationResult& result) {
+            model.validationHistory.push_back(result);
+            std::ostringstream text;
+            text << "Validation after epoch " << result.epoch + 1 << ": loss " << result.loss;
+            if (!std::isnan(result.accuracy)) {
+                text << ", accuracy " << result.accuracy * 100.0 << "%";
+            }
+            reporter.note("validation", text.str(), { { "epoch", result.epoch + 1.0 }, { "loss", result.loss }, { "accuracy", result.accuracy } });
+
+            if (result.loss < bestLoss - minDelta) {
+                bestLoss = result.loss;
+                bestEpoch = result.epoch;
+                if (patience > 0 && restoreBest) {
+                    saveBest();
+                }
+            }
+            if (patience > 0 && result.epoch - bestEpoch >= patience) {
+                reporter.note("early_stop", "Early stopping: no improvement since epoch " + std::to_string(bestEpoch + 1), { { "best_epoch", bestEpoch + 1.0 } });
+                return true;
+            }
+            return false;
+        }
+
+        // The snapshot still holds the recorded epoch's weights
+        void saveBest() {
+            std::vector<Parameter> local = snapshot->parameters();
+            std::vector<Tensor2<double>*> localState = snapshot->buffers();
+            if (best.empty()) {
+                for (Parameter& parameter : local) {
+                    best.push_back(*parameter.value);
+                }
+                for (Tensor2<double>* buffer : localState) {
+                    best.push_back(*buffer);
+                }
+                return;
+            }
+            for (size_t i = 0; i < local.size(); ++i) {
+                copyRows(best[i], *local[i].value);
+            }
+            for (size_t i = 0; i < localState.size(); ++i) {
+                copyRows(best[local.size() + i], *localState[i]);
+            }
+        }
+    };
+
+    // Replaces the replica's parameter values with views of this model's, freeing its copies. The
+    // replica then holds only its own gradients, caches and buffers, and never needs its weights
+    // refreshed: the optimizer's updates to this model are what it reads on the next step.
+    void shareParameters(Model& replica) {
+        std::vector<Parameter> params = parameters();
+        std::vector<Parameter> local = replica.parameters();
+        for (size_t i = 0; i < params.size(); ++i) {
+            *local[i].value = Tensor2<double>::view(*params[i].value);
+        }
+    }
+
+    void setMixedPrecision(bool enabled) {
+        for (const std::string& key : layers.getKeys()) {
+            layers.get(key)->setMixedPrecision(enabled);
+        }
+    }
+
+    // Forward and backward for one batch of an accumulation group of groupColumns columns
+    double accumulateStep(const Tensor2<double>& batchInput, const Tensor2<double>& batchTarget, int groupColumns) {
+        Tensor2<double> output = forward(batchInput, true);
+        Tensor2<double> grad;
+        double loss = lossFunc->forwardBackward(output, batchTarget, grad);
+        lossFunc->weightSliceGradient(grad, groupColumns);
+        backpropagate(std::move(grad));
+        return loss;
+    }
+
+    // Synchronous data-parallel forward/backward. Each replica runs forward and backward on its own column shard.
+    // Replicas read the model's weights in place (shareParameters), so only the small running
+    // statistics are copied to them per step.
+    // The loss sees the gathered output exactly as a single-threaded step would. Shard gradients are
+    // summed pairwise in a fixed tree and added to the model's gradients, so a given thread count
+    // reproduces bit for bit.
+    double parallelStep(ThreadPool& pool, std::vector<std::unique_ptr<Model>>& replicas,
+                        const Tensor2<double>& batchInput, const Tensor2<double>& batchTarget, int groupColumns) {
+        const int cols = batchInput.getShape()[1];
+        const int shards = std::min(static_cast<int>(replicas.size()), cols);
+        auto shardStart = [&](int shard) {
+            return static_cast<int>(static_cast<long long>(cols) * shard / shards);
+        };
+
+        std::vector<Parameter> params = parameters();
+        std::vector<Tensor2<double>*> state = buffers();
+        std::vector<std::vector<Parameter>> shardParams(shards);
+        std::vector<std::vector<Tensor2<double>*>> shardState(shards);
+        std::vector<Tensor2<double>> outputs(shards);
+
+        pool.run(shards, [&](int shard) {
+            Model& replica = *replicas[shard];
+            shardParams[shard] = replica.parameters();
+            shardState[shard] = replica.buffers();
+            for (size_t i = 0; i < state.size(); ++i) {
+                copyRows(*shardState[shard][i], *state[i]);
+            }
+            outputs[shard] = replica.forward(batchInput.slice(shardStart(shard), shardStart(shard + 1), 1), true);
+        });
+
+        Tensor2<double> output = concatenateColumns(outputs);
+        Tensor2<double> grad;
+        double loss = lossFunc->forwardBackward(output, batchTarget, grad);
+        lossFunc->weightSliceGradient(grad, groupColumns);
+
+        pool.run(shards, [&](int shard) {
+            replicas[shard]->backpropagate(grad.slice(shardStart(shard), shardStart(shard + 1), 1));
+        });
+
+        // At distance d, every shard that is a multiple of 2d absorbs shard + d
+        for (int distance = 1; distance < shards; distance *= 2) {
+            const int pairs = (shards - distance + 2 * distance - 1) / (2 * distance);
+            pool.run(pairs, [&](int pair) {
+                const int shard = pair * 2 * distance;
+                for (size_t i = 0; i < params.size(); ++i) {
+                    accumulateGradient(shardParams[shard][i], shardParams[shard + distance][i]);
+                }
+            });
+        }
+        for (size_t i = 0; i < params.size(); ++i) {
+            accumulateGradient(params[i], shardParams[0][i]);
+        }
+
+        // Running statistics: the mean of what each shard computed
+        for (size_t i = 0; i < state.size(); ++i) {
+            Tensor2<double>& target = *state[i];
+            for (int r = 0; r < target.getShape()[0]; ++r) {
+                double* dst = target[r].getData();
+                for (int c = 0; c < target.getShape()[1]; ++c) {
+                    double sum = 0.0;
+                    for (int shard = 0; shard < shards; ++shard) {
+                        sum += (*shardState[shard][i])[r][c];
+                    }
+                    dst[c] = sum / shards;
+                }
+            }
+        }
+
+        return loss;
+    }
+
+    // Hogwild epoch. Workers claim minibatches from a shared counter; nobody waits for anybody.
+    // Each worker's replica reads the shared weights directly (see shareParameters), computes a gradient
+    // and subtracts it in place. The races are deliberate: a torn read or a lost update only costs a
+    // little progress, and sparse layers (Embedding) only write the rows their minibatch used.
+    // With accumulation, a mean-reduced gradient is weighted as a share of a full group, and the
+    // update of a group that ends up shorter is scaled back up through its learning rate.
+    double asynchronousEpoch(ThreadPool& pool, std::vector<std::unique_ptr<Model>>& replicas, const Tensor2<double>& input,
+                             const Tensor2<double>& target, const std::vector<int>& order, int batchSize, int accumulationSteps, double learningRate, MetricsReporter& reporter) {
+        const int samples = input.getShape()[1];
+        const int totalBatches = (samples + batchSize - 1) / batchSize;
+        const int workers = static_cast<int>(replicas.size());
+        std::vector<Parameter> params = parameters();
+        std::vector<Tensor2<double>*> state = buffers();
+        std::vector<double> losses(workers, 0.0);
+        std::atomic<int> nextBatch(0);
+
+        pool.run(workers, [&](int worker) {
+            Model& replica = *replicas[worker];
+            std::vector<Parameter> local = replica.parameters();
+            std::vector<Tensor2<double>*> localState = replica.buffers();
+            Tensor2<double> batchInput;
+            Tensor2<double> batchTarget;
+            const int fullGroup = accumulationSteps * batchSize;
+            int pendingSteps = 0;
+            int groupColumns = 0;
+            int batch;
+            while ((batch = nextBatch.fetch_add(1)) < totalBatches) {
+                auto stepStart = std::chrono::steady_clock::now();
+                const int start = batch * batchSize;
+                const int end = std::min(start + batchSize, samples);
+                if (order.empty()) {
+                    batchInput = input.slice(start, end, 1);
+                    batchTarget = target.slice(start, end, 1);
+                }
+                else {
+                    input.gatherColumns(order, start, end, batchInput);
+                    target.gatherColumns(order, start, end, batchTarget);
+                }
+                Tensor2<double> output = replica.forward(batchInput, true);
+                Tensor2<double> grad;
+                double loss = lossFunc->forwardBackward(output, batchTarget, grad);
+                lossFunc->weightSliceGradient(grad, fullGroup);
+                replica.backpropagate(std::move(grad));
+                losses[worker] += loss;
+                groupColumns += end - start;
+
+                if (++pendingSteps == accumulationSteps) {
+                    publish(params, local, state, localState, learningRate / lossFunc->gradientWeight(groupColumns, fullGroup));
+                    pendingSteps = 0;
+                    groupColumns = 0;
+                }
+
+                // Lock-free, so every worker reports its own steps
+                reporter.record(end - start, loss, std::chrono::duration<double>(std::chrono::steady_clock::now() - stepStart).count());
+            }
+            if (pendingSteps > 0) {
+                publish(params, local, state, localState, learningRate / lossFunc->gradientWeight(groupColumns, fullGroup));
+            }
+        });
+
+        double overallLoss = 0.0;
+        for (double loss : losses) {
+            overallLoss += loss;
+        }
+        return overallLoss / totalBatches;
+    }
+
+    static void publish(std::vector<Parameter>& params, std::vector<Parameter>& local, std::vector<Tensor2<double>*>& state,
+                        std::vector<Tensor2<double>*>& localState, double learningRate) {
+        for (size_t i = 0; i < params.size(); ++i) {
+            applyUnsynchronized(params[i], local[i], learningRate);
+        }
+        for (size_t i = 0; i < state.size(); ++i) {
+            copyRows(*state[i], *localState[i]);
+        }
+    }
+
+    // shared.value -= learningRate * local.grad with plain loads and stores, then clears local.grad
+    static void applyUnsynchronized(Parameter& shared, Parameter& local, double learningRate) {
+        auto updateRow = [&](double* w, double* g, int cols) {
+            for (int c = 0; c < cols; ++c) {
+                w[c] -= learningRate * g[c];
+                g[c] = 0.0;
+            }
+        };
+
+        if (local.sparse == nullptr) {
+            const int cols = local.grad->getShape()[1];
+            for (int r = 0; r < local.grad->getShape()[0]; ++r) {
+                updateRow((*shared.value)[r].getData(), (*local.grad)[r].getData(), cols);
+            }
+            return;
+        }
+        SparseGradient& grad = *local.sparse;
+        for (int k = 0; k < grad.size(); ++k) {
+            updateRow((*shared.value)[grad.rowIndex(k)].getData(), grad.values(k), grad.getCols());
+        }
+        grad.clear();
+    }
+
+    // The indices of the k highest scores of each column, best first
+    static Tensor2<double> topClasses(const Tensor2<double>& scores, int k) {
+        const int rows = scores.getShape()[0];
+        const int cols = scores.getShape()[1];
+        k = std::min(k, rows);
+        Tensor2<double> result({ k, cols });
+        std::vector<int> ranking(rows);
+        for (int j = 0; j < cols; ++j) {
+            for (int i = 0; i < rows; ++i) {
+                ranking[i] = i;
+            }
+            std::partial_sort(ranking.begin(), ranking.begin() + k, ranking.end(), [&](int a, int b) {
+                return scores[a][j] > scores[b][j] || (scores[a][j] == scores[b][j] && a < b);
+            });
+            for (int i = 0; i < k; ++i) {
+                result[i][j] = ranking[i];
+            }
+        }
+        return result;
+    }
+
+    // dst[:, start:start + src's columns] = src
+    static void copyColumnsInto(Tensor2<double>& dst, const Tensor2<double>& src, int start) {
+        const int width = src.getShape()[1];
+        for (int r = 0; r < src.getShape()[0]; ++r) {
+            std::memcpy(dst[r].getData() + start, src[r].getData(), sizeof(double) * width);
+        }
+    }
+
+    static void copyRows(Tensor2<double>& dst, const Tensor2<double>& src) {
+        for (int r = 0; r < src.getShape()[0]; ++r) {
+            std::memcpy(dst[r].getData(), src[r].getData(), sizeof(double) * src.getShape()[1]);
+        }
+    }
+
+    // dst.grad += src.grad, leaving src zeroed; sparse parameters only visit the rows src touched
+    static void accumulateGradient(Parameter& dst, Parameter& src) {
+        if (src.sparse != nullptr) {
+            dst.sparse->absorb(*src.sparse);
+            return;
+        }
+        const int cols = src.grad->getShape()[1];
+        for (int r = 0; r < src.grad->getShape()[0]; ++r) {
+            double* d = (*dst.grad)[r].getData();
+            double* s = (*src.grad)[r].getData();
+            for (int c = 0; c < cols; ++c) {
+                d[c] += s[c];
+                s[c] = 0.0;
+            }
+        }
+    }
+
+    static Tensor2<double> concatenateColumns(const std::vector<Tensor2<double>>& parts) {
+        const int rows = parts[0].getShape()[0];
+        int cols = 0;
+        for (const Tensor2<double>& part : parts) {
+            cols += part.getShape()[1];
+        }
+
+        Tensor2<double> result({ rows, cols });
+        for (int r = 0; r < rows; ++r) {
+            double* dst = result[r].getData();
+            for (const Tensor2<double>& part : parts) {
+                const int width = part.getShape()[1];
+                std::memcpy(dst, part[r].getData(), sizeof(double) * width);
+                dst += width;
+            }
+        }
+        return result;
     }
 
-    Stack<Layer*> forwardStack;
+protected:
+    FusionReport fusionReport;
+    double inputStallSeconds = 0.0;
+    std::vector<ValidationResult> validationHistory;
 };
\ No newline at end of file
@@ -0,0 +1,184 @@
+#pragma once
+#include "Layer.h"
+#include "Tensor.h"
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+
+// Applies the gradients layers accumulated during backward. step() walks every parameter of the
+// model in one call and, per element, reads the gradient once, updates the weight and any moment
+// buffers, and clears the gradient, so no temporary tensors are created. Sparse parameters only
+// step the rows their gradient holds, and keep moment buffers only for rows that ever had one.
+class Optimizer {
+public:
+    virtual ~Optimizer() {}
+
+    void step(std::vector<Parameter>& parameters, double learningRate) {
+        iteration++;
+        begin(learningRate);
+        for (Parameter& parameter : parameters) {
+            Slots& slots = state(parameter);
+            const int cols = parameter.value->getShape()[1];
+            if (parameter.sparse == nullptr) {
+                for (int i = 0; i < parameter.value->getShape()[0]; ++i) {
+                    update((*parameter.value)[i].getData(), (*parameter.grad)[i].getData(),
+                           slotCount() > 0 ? slots.first[i].getData() : nullptr,
+                           slotCount() > 1 ? slots.second[i].getData() : nullptr, cols);
+                }
+                continue;
+            }
+
+            SparseGradient& grad = *parameter.sparse;
+            for (int k = 0; k < grad.size(); ++k) {
+                const int row = grad.rowIndex(k);
+                double* first = nullptr;
+                double* second = nullptr;
+                if (slotCount() > 0) {
+                    const size_t offset = sparseSlot(slots, row, cols);
+                    first = slots.sparseFirst.data() + offset;
+                    second = slotCount() > 1 ? slots.sparseSecond.data() + offset : nullptr;
+                }
+                update((*parameter.value)[row].getData(), grad.values(k), first, second, cols);
+            }
+            grad.clear();
+        }
+    }
+
+    int getIteration() const {
+        return iteration;
+    }
+
+protected:
+    // Moment buffers of one parameter: full-shape tensors for dense parameters; for sparse ones a row
+    // of each per row that has stepped, at rowOffsets[row]
+    struct Slots {
+        Tensor2<double> first;
+        Tensor2<double> second;
+        std::unordered_map<int, size_t> rowOffsets;
+        std::vector<double> sparseFirst;
+        std::vector<double> sparseSecond;
+    };
+
+    int iteration = 0;
+
+    // Per-step constants (bias corrections and the like)
+    virtual void begin(double learningRate) = 0;
+    // One row: w -= f(g), then g = 0. first and second are the row's moment buffers (null past slotCount).
+    virtual void update(double* w, double* g, double* first, double* second, int cols) = 0;
+    virtual int slotCount() const = 0;
+
+private:
+    std::unordered_map<const Tensor2<double>*, Slots> slotsByParameter;
+
+    Slots& state(const Parameter& parameter) {
+        auto found = slotsByParameter.find(parameter.value);
+        if (found != slotsByParameter.end()) {
+            return found->second;
+        }
+        Slots& slots = slotsByParameter[parameter.value];
+        if (parameter.sparse != nullptr) {
+            return slots;
+        }
+        if (slotCount() > 0) {
+            slots.first = Tensor2<double>(parameter.value->getShape());
+        }
+        if (slotCount() > 1) {
+            slots.second = Tensor2<double>(parameter.value->getShape());
+        }
+        return slots;
+    }
+
+    // Offset of row's moment buffers, zero-initialized the first time the row steps
+    size_t sparseSlot(Slots& slots, int row, int cols) {
+        auto found = slots.rowOffsets.find(row);
+        if (found != slots.rowOffsets.end()) {
+            return found->second;
+        }
+        const size_t offset = slots.sparseFirst.size();
+        slots.rowOffsets.emplace(row, offset);
+        slots.sparseFirst.resize(offset + cols, 0.0);
+        if (slotCount() > 1) {
+            slots.sparseSecond.resize(offset + cols, 0.0);
+        }
+        return offset;
+    }
+};
+
+// Plain SGD, or heavy-ball momentum: v = momentum * v + g, w -= lr * v
+class SGD : public Optimizer {
+public:
+    SGD(double momentum = 0.0) : momentum(momentum) {}
+
+protected:
+    void begin(double learningRate) override {
+        rate = learningRate;
+    }
+
+    void update(double* w, double* g, double* v, double*, int cols) override {
+        if (momentum == 0.0) {
+            for (int j = 0; j < cols; ++j) {
+                w[j] -= rate * g[j];
+                g[j] = 0.0;
+            }
+            return;
+        }
+
+        for (int j = 0; j < cols; ++j) {
+            v[j] = momentum * v[j] + g[j];
+            w[j] -= rate * v[j];
+            g[j] = 0.0;
+        }
+    }
+
+    int slotCount() const override {
+        return momentum == 0.0 ? 0 : 1;
+    }
+
+private:
+    double momentum;
+    double rate = 0.0;
+};
+
+// Adam with bias-corrected moments. A non-zero weightDecay is decoupled (AdamW): the weights shrink
+// by lr * weightDecay directly instead of the decay being folded into the gradient.
+class Adam : public Optimizer {
+public:
+    Adam(double beta1 = 0.9, double beta2 = 0.999, double epsilon = 1e-8, double weightDecay = 0.0)
+        : beta1(beta1), beta2(beta2), epsilon(epsilon), weightDecay(weightDecay) {}
+
+protected:
+    void begin(double learningRate) override {
+        stepSize = learningRate / (1.0 - std::pow(beta1, iteration));
+        secondCorrection = 1.0 / (1.0 - std::pow(beta2, iteration));
+        decay = 1.0 - learningRate * weightDecay;
+    }
+
+    void update(double* w, double* g, double* m, double* v, int cols) override {
+        for (int j = 0; j < cols; ++j) {
+            m[j] = beta1 * m[j] + (1.0 - beta1) * g[j];
+            v[j] = beta2 * v[j] + (1.0 - beta2) * g[j] * g[j];
+            w[j] = w[j] * decay - stepSize * m[j] / (std::sqrt(v[j] * secondCorrection) + epsilon);
+            g[j] = 0.0;
+        }
+    }
+
+    int slotCount() const override {
+        return 2;
+    }
+
+private:
+    double beta1;
+    double beta2;
+    double epsilon;
+    double weightDecay;
+    double stepSize = 0.0;
+    double secondCorrection = 1.0;
+    double decay = 1.0;
+};
+
+class AdamW : public Adam {
+public:
+    AdamW(double weightDecay = 0.01, double beta1 = 0.9, double beta2 = 0.999, double epsilon = 1e-8)
+        : Adam(beta1, beta2, epsilon, weightDecay) {}
+};
@@ -0,0 +1,291 @@
+#pragma once
+#include "Layer.h"
+#include "Tensor.h"
+#include "Model.h"
+#include <vector>
+
+// Pooling layers share Conv2D's (channels * height * width) x batch layout. Each row holds one
+// pixel across the whole batch, so every kernel below is an elementwise loop over contiguous
+// batch rows that the compiler vectorizes.
+
+class MaxPool2D : public Layer {
+public:
+    MaxPool2D(int channels, int inHeight, int inWidth, int poolSize = 2, int stride = -1)
+        : channels(channels), inHeight(inHeight), inWidth(inWidth), poolSize(poolSize), stride(stride == -1 ? poolSize : stride) {
+        if (poolSize <= 0 || this->stride <= 0 || poolSize > inHeight || poolSize > inWidth) {
+            std::cerr << "Invalid pooling geometry" << std::endl;
+            throw std::invalid_argument("Invalid pooling geometry");
+        }
+        if (poolSize * poolSize > 256) {
+            std::cerr << "MaxPool2D windows are limited to 256 elements" << std::endl;
+            throw std::invalid_argument("MaxPool2D windows are limited to 256 elements");
+        }
+        outHeight = (inHeight - poolSize) / this->stride + 1;
+        outWidth = (inWidth - poolSize) / this->stride + 1;
+        batchSize = 0;
+    }
+
+    Tensor2<double> forward(const Tensor2<double>& input, bool training = false) override {
+        if (!training) {
+            return predict(input);
+        }
+
+        model->forwardStack.push(this);
+        batchSize = input.getShape()[1];
+        // One byte per output element: the winning offset inside its window
+        argmaxCache.assign(static_cast<size_t>(getOutputSize()) * batchSize, 0);
+        return pool(input, argmaxCache.data());
+    }
+
+    Tensor2<double> predict(const Tensor2<double>& input) const override {
+        return pool(input, nullptr);
+    }
+
+    Tensor2<double> backward(const Tensor2<double>& dA) override {
+        Tensor2<double> dInput({ channels * inHeight * inWidth, batchSize });
+
+        for (int c = 0; c < channels; ++c) {
+            for (int oy = 0; oy < outHeight; ++oy) {
+                for (int ox = 0; ox < outWidth; ++ox) {
+                    int outRow = (c * outHeight + oy) * outWidth + ox;
+                    const double* grad = dA[outRow].getData();
+                    const unsigned char* idx = argmaxCache.data() + static_cast<size_t>(outRow) * batchSize;
+                    for (int b = 0; b < batchSize; ++b) {
+                        int iy = oy * stride + idx[b] / poolSize;
+                        int ix = ox * stride + idx[b] % poolSize;
+                        dInput[(c * inHeight + iy) * inWidth + ix][b] += grad[b];
+                    }
+                }
+            }
+        }
+        return dInput;
+    }
+
+    int getOutputSize() const override {
+        return channels * outHeight * outWidth;
+    }
+
+    // One argmax byte per output element
+    size_t trainingCacheBytes(int /*inputWidth*/, int batchSize) const override {
+        return static_cast<size_t>(getOutputSize()) * batchSize;
+    }
+
+    void releaseCache() override {
+        argmaxCache = std::vector<unsigned char>();
+    }
+
+    Layer* clone() const override {
+        return new MaxPool2D(*this);
+    }
+
+private:
+    int channels;
+    int inHeight;
+    int inWidth;
+    int outHeight;
+    int outWidth;
+    int poolSize;
+    int stride;
+    int batchSize;
+    std::vector<unsigned char> argmaxCache;
+
+    Tensor2<double> pool(const Tensor2<double>& input, unsigned char* argmax) const {
+        if (input.getShape()[0] != channels * inHeight * inWidth) {
+            std::cerr << "Pooling input must have channels * height * width rows" << std::endl;
+            throw std::invalid_argument("Pooling input must have channels * height * width rows");
+        }
+        const int batch = input.getShape()[1];
+        Tensor2<double> result({ getOutputSize(), batch });
+
+        for (int c = 0; c < channels; ++c) {
+            for (int oy = 0; oy < outHeight; ++oy) {
+                for (int ox = 0; ox < outWidth; ++ox) {
+                    int outRow = (c * outHeight + oy) * outWidth + ox;
+                    double* out = result[outRow].getData();
+                    unsigned char* idx = argmax ? argmax + static_cast<size_t>(outRow) * batch : nullptr;
+
+                    const double* first = input[(c * inHeight + oy * stride) * inWidth + ox * stride].getData();
+                    for (int b = 0; b < batch; ++b) {
+                        out[b] = first[b];
+                    }
+
+                    for (int w = 1; w < poolSize * poolSize; ++w) {
+                        int iy = oy * stride + w / poolSize;
+                        int ix = ox * stride + w % poolSize;
+                        const double* src = input[(c * inHeight + iy) * inWidth + ix].getData();
+                        if (idx) {
+                            for (int b = 0; b < batch; ++b) {
+                                bool greater = src[b] > out[b];
+                                out[b] = greater ? src[b] : out[b];
+                                idx[b] = greater ? static_cast<unsigned char>(w) : idx[b];
+                            }
+                        } else {
+                            for (int b = 0; b < batch; ++b) {
+                                out[b] = src[b] > out[b] ? src[b] : out[b];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        return result;
+    }
+};
+
+class AvgPool2D : public Layer {
+public:
+    AvgPool2D(int channels, int inHeight, int inWidth, int poolSize = 2, int stride = -1)
+        : channels(channels), inHeight(inHeight), inWidth(inWidth), poolSize(poolSize), stride(stride == -1 ? poolSize : stride) {
+        if (poolSize <= 0 || this->stride <= 0 || poolSize > inHeight || poolSize > inWidth) {
+            std::cerr << "Invalid pooling geometry" << std::endl;
+            throw std::invalid_argument("Invalid pooling geometry");
+        }
+        outHeight = (inHeight - poolSize) / this->stride + 1;
+        outWidth = (inWidth - poolSize) / this->stride + 1;
+    }
+
+    Tensor2<double> forward(const Tensor2<double>& input, bool training = false) override {
+        if (training) {
+            // Nothing to cache: the gradient is spread evenly over each window
+            model->forwardStack.push(this);
+        }
+        return predict(input);
+    }
+
+    Tensor2<double> predict(const Tensor2<double>& input) const override {
+        if (input.getShape()[0] != channels * inHeight * inWidth) {
+            std::cerr << "Pooling input must have channels * height * width rows" << std::endl;
+            throw std::invalid_argument("Pooling input must have channels * height * width rows");
+        }
+        const int batch = input.getShape()[1];
+        const double scale = 1.0 / (poolSize * poolSize);
+        Tensor2<double> result({ getOutputSize(), batch });
+
+        for (int c = 0; c < channels; ++c) {
+            for (int oy = 0; oy < outHeight; ++oy) {
+                for (int ox = 0; ox < outWidth; ++ox) {
+                    double* out = result[(c * outHeight + oy) * outWidth + ox].getData();
+                    for (int ky = 0; ky < poolSize; ++ky) {
+                        for (int kx = 0; kx < poolSize; ++kx) {
+                            const double* src = input[(c * inHeight + oy * stride + ky) * inWidth + ox * stride + kx].getData();
+                            for (int b = 0; b < batch; ++b) {
+                                out[b] += src[b];
+                            }
+                        }
+                    }
+                    for (int b = 0; b < batch; ++b) {
+                        out[b] *= scale;
+                    }
+                }
+            }
+        }
+        return result;
+    }
+
+    Tensor2<double> backward(const Tensor2<double>& dA) override {
+        const int batch = dA.getShape()[1];
+        const double scale = 1.0 / (poolSize * poolSize);
+        Tensor2<double> dInput({ channels * inHeight * inWidth, batch });
+
+        for (int c = 0; c < channels; ++c) {
+            for (int oy = 0; oy < outHeight; ++oy) {
+                for (int ox = 0; ox < outWidth; ++ox) {
+                    const double* grad = dA[(c * outHeight + oy) * outWidth + ox].getData();
+                    for (int ky = 0; ky < poolSize; ++ky) {
+                        for (int kx = 0; kx < poolSize; ++kx) {
+                            double* dst = dInput[(c * inHeight + oy * stride + ky) * inWidth + ox * stride + kx].getData();
+                            for (int b = 0; b < batch; ++b) {
+                                dst[b] += grad[b] * scale;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        return dInput;
+    }
+
+    int getOutputSize() const override {
+        return channels * outHeight * outWidth;
+    }
+
+    Layer* clone() const override {
+        return new AvgPool2D(*this);
+    }
+
+private:
+    int channels;
+    int inHeight;
+    int inWidth;
+    int outHeight;
+    int outWidth;
+    int poolSize;
+    int stride;
+};
+
+// Averages every channel down to a single value: (C * H * W) x batch -> C x batch
+class GlobalAvgPool : public Layer {
+public:
+    GlobalAvgPool(int channels, int inHeight, int inWidth) : channels(channels), inHeight(inHeight), inWidth(inWidth) {}
+
+    Tensor2<double> forward(const Tensor2<double>& input, bool training = false) override {
+        if (training) {
+            model->forwardStack.push(this);
+        }
+        return predict(input);
+    }
+
+    Tensor2<double> predict(const Tensor2<double>& input) const override {
+        const int area = inHeight * inWidth;
+        if (input.getShape()[0] != channels * area) {
+            std::cerr << "Pooling input must have channels * height * width rows" << std::endl;
+            throw std::invalid_argument("Pooling input must have channels * height * width rows");
+        }
+        const int batch = input.getShape()[1];
+        Tensor2<double> result({ channels, batch });
+
+        for (int c = 0; c < channels; ++c) {
+            double* out = result[c].getData();
+            for (int p = 0; p < area; ++p) {
+                const double* src = input[c * area + p].getData();
+                for (int b = 0; b < batch; ++b) {
+                    out[b] += src[b];
+                }
+            }
+            for (int b = 0; b < batch; ++b) {
+                out[b] /= area;
+            }
+        }
+        return result;
+    }
+
+    Tensor2<double> backward(const Tensor2<double>& dA) override {
+        const int area = inHeight * inWidth;
+        const int batch = dA.getShape()[1];
+        Tensor2<double> dInput({ channels * area, batch });
+
+        for (int c = 0; c < channels; ++c) {
+            const double* grad = dA[c].getData();
+            for (int p = 0; p < area; ++p) {
+                double* dst = dInput[c * area + p].getData();
+                for (int b = 0; b < batch; ++b) {
+                    dst[b] = grad[b] / area;
+                }
+            }
+        }
+        return dInput;
+    }
+
+    int getOutputSize() const override {
+        return channels;
+    }
+
+    Layer* clone() const override {
+        return new GlobalAvgPool(*this);
+    }
+
+private:
+    int channels;
+    int inHeight;
+    int inWidth;
+};
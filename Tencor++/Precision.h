@@ -0,0 +1,198 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include "Tensor.h"
+#include "Layer.h"
+#include "Loss.h"
+
+// Reduced-precision storage for mixed-precision training. Weights, gradients and optimizer state stay
+// in double; layers that support it run their GEMMs in float and keep the activations they cache for
+// backward as bfloat16 (the top half of a float: same exponent range, 8 mantissa bits), a quarter of
+// the memory of the double copies.
+
+// Round to nearest even; NaN stays NaN
+inline uint16_t toBFloat16(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    if ((bits & 0x7fffffffu) > 0x7f800000u) {
+        return static_cast<uint16_t>((bits >> 16) | 0x40u);
+    }
+    bits += 0x7fffu + ((bits >> 16) & 1u);
+    return static_cast<uint16_t>(bits >> 16);
+}
+
+inline float fromBFloat16(uint16_t value) {
+    uint32_t bits = static_cast<uint32_t>(value) << 16;
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+template <typename To, typename From>
+Tensor2<To> convertTensor(const Tensor2<From>& source) {
+    const int rows = source.getShape()[0];
+    const int cols = source.getShape()[1];
+    Tensor2<To> result({ rows, cols });
+    for (int i = 0; i < rows; ++i) {
+        const From* src = source[i].getData();
+        To* dst = result[i].getData();
+        for (int j = 0; j < cols; ++j) {
+            dst[j] = static_cast<To>(src[j]);
+        }
+    }
+    return result;
+}
+
+// Row-major rows x cols matrix of bfloat16 values in one allocation
+class BFloat16Tensor {
+public:
+    BFloat16Tensor() : rows(0), cols(0) {}
+
+    explicit BFloat16Tensor(const Tensor2<double>& source) : rows(source.getShape()[0]), cols(source.getShape()[1]) {
+        data.resize(static_cast<size_t>(rows) * cols);
+        for (int i = 0; i < rows; ++i) {
+            const double* src = source[i].getData();
+            uint16_t* dst = data.data() + static_cast<size_t>(i) * cols;
+            for (int j = 0; j < cols; ++j) {
+                dst[j] = toBFloat16(static_cast<float>(src[j]));
+            }
+        }
+    }
+
+    template <typename T>
+    Tensor2<T> unpack() const {
+        Tensor2<T> result({ rows, cols });
+        for (int i = 0; i < rows; ++i) {
+            const uint16_t* src = data.data() + static_cast<size_t>(i) * cols;
+            T* dst = result[i].getData();
+            for (int j = 0; j < cols; ++j) {
+                dst[j] = static_cast<T>(fromBFloat16(src[j]));
+            }
+        }
+        return result;
+    }
+
+    size_t bytes() const {
+        return data.size() * sizeof(uint16_t);
+    }
+
+private:
+    int rows;
+    int cols;
+    std::vector<uint16_t> data;
+};
+
+// Dynamic loss scaling. Wraps the training loss and multiplies its gradient by the current scale, so
+// small gradients stay representable in reduced precision; the reported loss is unscaled. After
+// backward, unscale() divides the gradients back down. If any of them overflowed to inf or NaN the
+// step is skipped instead: gradients are cleared and the scale halves. Every growthInterval clean
+// steps the scale doubles again.
+class LossScaler : public Loss<double> {
+public:
+    LossScaler(Loss<double>& loss, double initialScale = 65536.0, int growthInterval = 2000)
+        : loss(loss), scale(initialScale), growthInterval(growthInterval), cleanSteps(0), skippedSteps(0) {}
+
+    double forward(const Tensor2<double>& prediction, const Tensor2<double>& target) override {
+        return loss.forward(prediction, target);
+    }
+
+    Tensor2<double> backward(const Tensor2<double>& prediction, const Tensor2<double>& target) override {
+        Tensor2<double> grad = loss.backward(prediction, target);
+        scaleInPlace(grad);
+        return grad;
+    }
+
+    double forwardBackward(const Tensor2<double>& prediction, const Tensor2<double>& target, Tensor2<double>& grad) override {
+        double value = loss.forwardBackward(prediction, target, grad);
+        scaleInPlace(grad);
+        return value;
+    }
+
+    LossReduction reduction() const override {
+        return loss.reduction();
+    }
+
+    // True when the gradients are finite and now unscaled, false when the step must be skipped
+    bool unscale(std::vector<Parameter>& parameters) {
+        bool finite = true;
+        for (Parameter& parameter : parameters) {
+            forEachRow(parameter, [&](double* g, int cols) {
+                for (int j = 0; j < cols; ++j) {
+                    finite = finite && std::isfinite(g[j]);
+                }
+            });
+        }
+
+        if (!finite) {
+            for (Parameter& parameter : parameters) {
+                if (parameter.sparse != nullptr) {
+                    parameter.sparse->clear();
+                    continue;
+                }
+                forEachRow(parameter, [](double* g, int cols) {
+                    std::fill(g, g + cols, 0.0);
+                });
+            }
+            scale /= 2.0;
+            cleanSteps = 0;
+            skippedSteps++;
+            return false;
+        }
+
+        const double inverse = 1.0 / scale;
+        for (Parameter& parameter : parameters) {
+            forEachRow(parameter, [&](double* g, int cols) {
+                for (int j = 0; j < cols; ++j) {
+                    g[j] *= inverse;
+                }
+            });
+        }
+        if (++cleanSteps == growthInterval) {
+            scale *= 2.0;
+            cleanSteps = 0;
+        }
+        return true;
+    }
+
+    double getScale() const {
+        return scale;
+    }
+
+    int getSkippedSteps() const {
+        return skippedSteps;
+    }
+
+private:
+    Loss<double>& loss;
+    double scale;
+    int growthInterval;
+    int cleanSteps;
+    int skippedSteps;
+
+    void scaleInPlace(Tensor2<double>& grad) const {
+        for (int i = 0; i < grad.getShape()[0]; ++i) {
+            double* g = grad[i].getData();
+            for (int j = 0; j < grad.getShape()[1]; ++j) {
+                g[j] *= scale;
+            }
+        }
+    }
+
+    // Sparse parameters only hold gradient in the rows they touched
+    template <typename Visit>
+    static void forEachRow(Parameter& parameter, Visit visit) {
+        if (parameter.sparse == nullptr) {
+            const int cols = parameter.grad->getShape()[1];
+            for (int i = 0; i < parameter.grad->getShape()[0]; ++i) {
+                visit((*parameter.grad)[i].getData(), cols);
+            }
+            return;
+        }
+        for (int k = 0; k < parameter.sparse->size(); ++k) {
+            visit(parameter.sparse->values(k), parameter.sparse->getCols());
+        }
+    }
+};
@@ -0,0 +1,174 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
+#include "Tensor.h"
+#include "SpscQueue.h"
+
+// Sample order for one epoch: empty (dataset order) without shuffling, otherwise a permutation that
+// depends only on seed and epoch, so every thread that needs it can rebuild the same one.
+inline std::vector<int> epochOrder(int samples, bool shuffle, uint32_t seed, int epoch) {
+    std::vector<int> order;
+    if (!shuffle) {
+        return order;
+    }
+    order.resize(samples);
+    std::iota(order.begin(), order.end(), 0);
+    std::seed_seq sequence{ seed, static_cast<uint32_t>(epoch) };
+    std::mt19937 generator(sequence);
+    std::shuffle(order.begin(), order.end(), generator);
+    return order;
+}
+
+// Assembles fit's batches on a background thread while the current one trains. A fixed ring of
+// depth + 1 batch buffers circulates between two SPSC queues: the producer takes a free buffer,
+// copies or gathers the batch's columns into it (reusing its storage), runs the optional prepare step and hands
+// it over; the trainer hands it back once the step is done. The producer runs ahead across epoch
+// boundaries, and the time the trainer spends waiting for a batch is recorded as stall time.
+class BatchPrefetcher {
+public:
+    struct Batch {
+        Tensor2<double> input;
+        Tensor2<double> target;
+        int start;
+        int end;
+    };
+
+    // Runs on the producer thread, after the batch is copied out: normalization, one-hot encoding,
+    // layout changes. Buffers are only reused while it keeps their shapes.
+    using Prepare = std::function<void(Tensor2<double>& input, Tensor2<double>& target)>;
+
+    BatchPrefetcher(const Tensor2<double>& input, const Tensor2<double>& target, int batchSize, int epochs, int depth,
+                    bool shuffle = false, uint32_t seed = 0, const Prepare& prepare = Prepare())
+        : input(input), target(target), batchSize(batchSize), epochs(epochs), shuffle(shuffle), seed(seed), prepare(prepare), ring(depth + 1),
+          free(depth + 1), ready(depth + 1), stopping(false), failed(false), stallSeconds(0.0) {
+        for (Batch& batch : ring) {
+            Batch* slot = &batch;
+            free.push(std::move(slot));
+        }
+        producer = std::thread([this] { produce(); });
+    }
+
+    ~BatchPrefetcher() {
+        stopping.store(true);
+        producer.join();
+    }
+
+    BatchPrefetcher(const BatchPrefetcher&) = delete;
+    BatchPrefetcher& operator=(const BatchPrefetcher&) = delete;
+
+    // The next batch in order; blocks, counting the wait as stall, and rethrows a producer failure
+    Batch* next() {
+        Batch* batch;
+        if (ready.tryPop(batch)) {
+            return batch;
+        }
+
+        auto started = std::chrono::steady_clock::now();
+        int spins = 0;
+        while (!ready.tryPop(batch)) {
+            if (failed.load(std::memory_order_acquire)) {
+                std::rethrow_exception(failure);
+            }
+            backoff(spins);
+        }
+        stallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        return batch;
+    }
+
+    // Gives a batch returned by next() back to the producer
+    void release(Batch* batch) {
+        free.push(std::move(batch));
+    }
+
+    // Stall time since the last call
+    double takeStallSeconds() {
+        double seconds = stallSeconds;
+        stallSeconds = 0.0;
+        return seconds;
+    }
+
+private:
+    const Tensor2<double>& input;
+    const Tensor2<double>& target;
+    const int batchSize;
+    const int epochs;
+    const bool shuffle;
+    const uint32_t seed;
+    Prepare prepare;
+    std::vector<Batch> ring;
+    SpscQueue<Batch*> free;
+    SpscQueue<Batch*> ready;
+    std::thread producer;
+    std::atomic<bool> stopping;
+    std::atomic<bool> failed;
+    std::exception_ptr failure;
+    double stallSeconds;
+
+    // Yields briefly, then sleeps, so a waiting side does not take a core from the compute threads
+    static void backoff(int& spins) {
+        if (++spins < 64) {
+            std::this_thread::yield();
+        }
+        else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+
+    void produce() {
+        try {
+            const int samples = input.getShape()[1];
+            for (int epoch = 0; epoch < epochs; ++epoch) {
+                std::vector<int> order = epochOrder(samples, shuffle, seed, epoch);
+                for (int start = 0; start < samples; start += batchSize) {
+                    Batch* batch;
+                    int spins = 0;
+                    while (!free.tryPop(batch)) {
+                        if (stopping.load()) {
+                            return;
+                        }
+                        backoff(spins);
+                    }
+                    batch->start = start;
+                    batch->end = std::min(start + batchSize, samples);
+                    if (order.empty()) {
+                        copyColumns(batch->input, input, batch->start, batch->end);
+                        copyColumns(batch->target, target, batch->start, batch->end);
+                    }
+                    else {
+                        input.gatherColumns(order, batch->start, batch->end, batch->input);
+                        target.gatherColumns(order, batch->start, batch->end, batch->target);
+                    }
+                    if (prepare) {
+                        prepare(batch->input, batch->target);
+                    }
+                    ready.push(std::move(batch));
+                }
+            }
+        }
+        catch (...) {
+            failure = std::current_exception();
+            failed.store(true, std::memory_order_release);
+        }
+    }
+
+    // dst = src[:, start:end], allocating only when dst's shape does not already match
+    static void copyColumns(Tensor2<double>& dst, const Tensor2<double>& src, int start, int end) {
+        const int rows = src.getShape()[0];
+        const int width = end - start;
+        if (dst.getShape().size() != 2 || dst.getShape()[0] != rows || dst.getShape()[1] != width) {
+            dst = Tensor2<double>({ rows, width });
+        }
+        for (int r = 0; r < rows; ++r) {
+            std::memcpy(dst[r].getData(), src[r].getData() + start, sizeof(double) * width);
+        }
+    }
+};
@@ -0,0 +1,508 @@
+#pragma once
+#include "Layer.h"
+#include "Tensor.h"
+#include "Model.h"
+#include <vector>
+#include <cstring>
+#include <cmath>
+
+// Shared plumbing for recurrent layers.
+// Input: (timesteps * inputSize) x batch, timestep-major (what Embedding produces).
+// Output: hiddenSize x batch for the last step, or (timesteps * hiddenSize) x batch with returnSequences.
+//
+// All gates are stacked into one weight matrix per side, so a timestep costs one recurrent GEMM,
+// and the input projection for the whole sequence is hoisted into a single GEMM over
+// (inputSize) x (timesteps * batch). Sequence buffers keep timestep t in columns [t * batch, (t + 1) * batch).
+class Recurrent : public Layer {
+public:
+    Recurrent(int inputSize, int hiddenSize, int timesteps, int gateCount, bool returnSequences)
+        : inputSize(inputSize), hiddenSize(hiddenSize), timesteps(timesteps), gateCount(gateCount), returnSequences(returnSequences) {
+        inputWeights = Tensor2<double>({ gateCount * hiddenSize, inputSize }, InitType::Random);
+        recurrentWeights = Tensor2<double>({ gateCount * hiddenSize, hiddenSize }, InitType::Random);
+        biases = Tensor2<double>({ gateCount * hiddenSize, 1 }, InitType::Random);
+        dInputWeights = Tensor2<double>(inputWeights.getShape());
+        dRecurrentWeights = Tensor2<double>(recurrentWeights.getShape());
+        dBiases = Tensor2<double>(biases.getShape());
+    }
+
+    std::vector<Parameter> parameters() override {
+        return { { &inputWeights, &dInputWeights }, { &recurrentWeights, &dRecurrentWeights }, { &biases, &dBiases } };
+    }
+
+    Tensor2<double>& getInputWeights() {
+        return inputWeights;
+    }
+
+    Tensor2<double>& getRecurrentWeights() {
+        return recurrentWeights;
+    }
+
+    Tensor2<double>& getBiases() {
+        return biases;
+    }
+
+    int getOutputSize() const override {
+        return returnSequences ? timesteps * hiddenSize : hiddenSize;
+    }
+
+protected:
+    int inputSize;
+    int hiddenSize;
+    int timesteps;
+    int gateCount;
+    bool returnSequences;
+    Tensor2<double> inputWeights;
+    Tensor2<double> recurrentWeights;
+    Tensor2<double> biases;
+    Tensor2<double> dInputWeights;
+    Tensor2<double> dRecurrentWeights;
+    Tensor2<double> dBiases;
+
+    static double sigmoid(double x) {
+        return 1.0 / (1.0 + std::exp(-x));
+    }
+
+    // Resizes a buffer only when its shape changes, so repeated steps with one batch size never reallocate
+    static void ensure(Tensor2<double>& buffer, int rows, int cols) {
+        if (buffer.getShape().size() != 2 || buffer.getShape()[0] != rows || buffer.getShape()[1] != cols) {
+            buffer = Tensor2<double>({ rows, cols });
+        }
+    }
+
+    static void zero(Tensor2<double>& buffer) {
+        for (int i = 0; i < buffer.getShape()[0]; ++i) {
+            std::memset(buffer[i].getData(), 0, sizeof(double) * buffer.getShape()[1]);
+        }
+    }
+
+    void checkInput(const Tensor2<double>& input) const {
+        if (input.getShape()[0] != timesteps * inputSize) {
+            std::cerr << "Recurrent input must have timesteps * inputSize rows" << std::endl;
+            throw std::invalid_argument("Recurrent input must have timesteps * inputSize rows");
+        }
+    }
+
+    // (timesteps * inputSize) x batch -> inputSize x (timesteps * batch)
+    void packInput(const Tensor2<double>& input, Tensor2<double>& packed) const {
+        const int batch = input.getShape()[1];
+        for (int t = 0; t < timesteps; ++t) {
+            for (int i = 0; i < inputSize; ++i) {
+                std::memcpy(packed[i].getData() + t * batch, input[t * inputSize + i].getData(), sizeof(double) * batch);
+            }
+        }
+    }
+
+    // inputSize x (timesteps * batch) -> (timesteps * inputSize) x batch
+    Tensor2<double> unpackInputGradient(const Tensor2<double>& packed, int batch) const {
+        Tensor2<double> result({ timesteps * inputSize, batch });
+        for (int t = 0; t < timesteps; ++t) {
+            for (int i = 0; i < inputSize; ++i) {
+                std::memcpy(result[t * inputSize + i].getData(), packed[i].getData() + t * batch, sizeof(double) * batch);
+            }
+        }
+        return result;
+    }
+
+    // previousHidden holds h(t - 1) in segment t; lastHidden holds h(T - 1)
+    Tensor2<double> collectOutput(const Tensor2<double>& previousHidden, const Tensor2<double>& lastHidden) const {
+        const int batch = lastHidden.getShape()[1];
+        if (!returnSequences) {
+            return lastHidden;
+        }
+
+        Tensor2<double> result({ timesteps * hiddenSize, batch });
+        for (int t = 0; t < timesteps; ++t) {
+            for (int j = 0; j < hiddenSize; ++j) {
+                const double* src = t + 1 < timesteps ? previousHidden[j].getData() + (t + 1) * batch : lastHidden[j].getData();
+                std::memcpy(result[t * hiddenSize + j].getData(), src, sizeof(double) * batch);
+            }
+        }
+        return result;
+    }
+
+    // Gradient reaching h(t) from the layer output, or nullptr if the output does not depend on it
+    const double* outputGradient(const Tensor2<double>& dA, int t, int j) const {
+        if (returnSequences) {
+            return dA[t * hiddenSize + j].getData();
+        }
+        return t == timesteps - 1 ? dA[j].getData() : nullptr;
+    }
+};
+
+// Gate order in the stacked weights: input, forget, cell candidate, output
+class LSTM : public Recurrent {
+public:
+    LSTM(int inputSize, int hiddenSize, int timesteps, bool returnSequences = false)
+        : Recurrent(inputSize, hiddenSize, timesteps, 4, returnSequences) {
+        // Start by remembering: forget-gate bias of one
+        for (int j = 0; j < hiddenSize; ++j) {
+            biases[hiddenSize + j][0] = 1.0;
+        }
+    }
+
+    Tensor2<double> forward(const Tensor2<double>& input, bool training = false) override {
+        if (!training) {
+            return predict(input);
+        }
+
+        model->forwardStack.push(this);
+        return run(input, workspace);
+    }
+
+    Tensor2<double> predict(const Tensor2<double>& input) const override {
+        Workspace local;
+        return run(input, local);
+    }
+
+    Tensor2<double> backward(const Tensor2<double>& dA) override {
+        Workspace& ws = workspace;
+        const int batch = ws.lastHidden.getShape()[1];
+        const int H = hiddenSize;
+
+        ensure(ws.dHidden, H, batch);
+        ensure(ws.dCell, H, batch);
+        ensure(ws.dGatesStep, 4 * H, batch);
+        ensure(ws.dGates, 4 * H, timesteps * batch);
+        zero(ws.dHidden);
+        zero(ws.dCell);
+
+        for (int t = timesteps - 1; t >= 0; --t) {
+            const int offset = t * batch;
+            for (int j = 0; j < H; ++j) {
+                const double* gi = ws.gates[j].getData() + offset;
+                const double* gf = ws.gates[H + j].getData() + offset;
+                const double* gg = ws.gates[2 * H + j].getData() + offset;
+                const double* go = ws.gates[3 * H + j].getData() + offset;
+                const double* cPrev = ws.cells[j].getData() + offset;
+                const double* c = ws.cells[j].getData() + offset + batch;
+                const double* dOut = outputGradient(dA, t, j);
+                double* dh = ws.dHidden[j].getData();
+                double* dc = ws.dCell[j].getData();
+                double* di = ws.dGatesStep[j].getData();
+                double* df = ws.dGatesStep[H + j].getData();
+                double* dg = ws.dGatesStep[2 * H + j].getData();
+                double* dO = ws.dGatesStep[3 * H + j].getData();
+
+                for (int b = 0; b < batch; ++b) {
+                    double dhTotal = dh[b] + (dOut ? dOut[b] : 0.0);
+                    double tc = std::tanh(c[b]);
+                    double dcTotal = dc[b] + dhTotal * go[b] * (1.0 - tc * tc);
+
+                    di[b] = dcTotal * gg[b] * gi[b] * (1.0 - gi[b]);
+                    df[b] = dcTotal * cPrev[b] * gf[b] * (1.0 - gf[b]);
+                    dg[b] = dcTotal * gi[b] * (1.0 - gg[b] * gg[b]);
+                    dO[b] = dhTotal * tc * go[b] * (1.0 - go[b]);
+                    dc[b] = dcTotal * gf[b];
+                }
+            }
+
+            for (int g = 0; g < 4 * H; ++g) {
+                std::memcpy(ws.dGates[g].getData() + offset, ws.dGatesStep[g].getData(), sizeof(double) * batch);
+            }
+            Tensor2<double>::dotInto(recurrentWeights, ws.dGatesStep, ws.dHidden, true, false);
+        }
+
+        return accumulateGradients(ws, batch);
+    }
+
+    // The whole workspace: what the forward saves for BPTT, and the gradient buffers backward
+    // keeps for the next step
+    size_t trainingCacheBytes(int /*inputWidth*/, int batchSize) const override {
+        const size_t sequence = static_cast<size_t>(timesteps) * batchSize;
+        const size_t H = hiddenSize;
+        const size_t forwardBuffers = inputSize * sequence + 2 * 4 * H * sequence + H * (sequence + batchSize) + H * sequence + H * batchSize + 4 * H * batchSize;
+        const size_t backwardBuffers = 2 * H * batchSize + 4 * H * batchSize + 4 * H * sequence + inputSize * sequence;
+        return sizeof(double) * (forwardBuffers + backwardBuffers);
+    }
+
+    void releaseCache() override {
+        workspace = Workspace();
+    }
+
+    Layer* clone() const override {
+        return new LSTM(*this);
+    }
+
+private:
+    struct Workspace {
+        Tensor2<double> packedInput;     // inputSize x (T * batch)
+        Tensor2<double> inputProjection; // 4H x (T * batch)
+        Tensor2<double> gates;           // 4H x (T * batch), activated
+        Tensor2<double> cells;           // H x ((T + 1) * batch), c(-1) in segment 0
+        Tensor2<double> previousHidden;  // H x (T * batch), h(t - 1) in segment t
+        Tensor2<double> lastHidden;      // H x batch
+        Tensor2<double> recurrent;       // 4H x batch
+        Tensor2<double> dHidden;
+        Tensor2<double> dCell;
+        Tensor2<double> dGatesStep;
+        Tensor2<double> dGates;
+        Tensor2<double> dPackedInput;
+    };
+
+    Workspace workspace;
+
+    Tensor2<double> run(const Tensor2<double>& input, Workspace& ws) const {
+        checkInput(input);
+        const int batch = input.getShape()[1];
+        const int H = hiddenSize;
+
+        ensure(ws.packedInput, inputSize, timesteps * batch);
+        ensure(ws.inputProjection, 4 * H, timesteps * batch);
+        ensure(ws.gates, 4 * H, timesteps * batch);
+        ensure(ws.cells, H, (timesteps + 1) * batch);
+        ensure(ws.previousHidden, H, timesteps * batch);
+        ensure(ws.lastHidden, H, batch);
+        ensure(ws.recurrent, 4 * H, batch);
+        zero(ws.lastHidden);
+        for (int j = 0; j < H; ++j) {
+            std::memset(ws.cells[j].getData(), 0, sizeof(double) * batch);
+        }
+
+        packInput(input, ws.packedInput);
+        Tensor2<double>::dotInto(inputWeights, ws.packedInput, ws.inputProjection);
+
+        for (int t = 0; t < timesteps; ++t) {
+            const int offset = t * batch;
+            for (int j = 0; j < H; ++j) {
+                std::memcpy(ws.previousHidden[j].getData() + offset, ws.lastHidden[j].getData(), sizeof(double) * batch);
+            }
+            Tensor2<double>::dotInto(recurrentWeights, ws.lastHidden, ws.recurrent);
+
+            // Fused epilogue: bias, all four nonlinearities and the cell update in one sweep
+            for (int j = 0; j < H; ++j) {
+                const double* xi = ws.inputProjection[j].getData() + offset;
+                const double* xf = ws.inputProjection[H + j].getData() + offset;
+                const double* xg = ws.inputProjection[2 * H + j].getData() + offset;
+                const double* xo = ws.inputProjection[3 * H + j].getData() + offset;
+                const double* ri = ws.recurrent[j].getData();
+                const double* rf = ws.recurrent[H + j].getData();
+                const double* rg = ws.recurrent[2 * H + j].getData();
+                const double* ro = ws.recurrent[3 * H + j].getData();
+                const double bi = biases[j][0];
+                const double bf = biases[H + j][0];
+                const double bg = biases[2 * H + j][0];
+                const double bo = biases[3 * H + j][0];
+                double* gi = ws.gates[j].getData() + offset;
+                double* gf = ws.gates[H + j].getData() + offset;
+                double* gg = ws.gates[2 * H + j].getData() + offset;
+                double* go = ws.gates[3 * H + j].getData() + offset;
+                const double* cPrev = ws.cells[j].getData() + offset;
+                double* c = ws.cells[j].getData() + offset + batch;
+                double* h = ws.lastHidden[j].getData();
+
+                for (int b = 0; b < batch; ++b) {
+                    gi[b] = sigmoid(xi[b] + ri[b] + bi);
+                    gf[b] = sigmoid(xf[b] + rf[b] + bf);
+                    gg[b] = std::tanh(xg[b] + rg[b] + bg);
+                    go[b] = sigmoid(xo[b] + ro[b] + bo);
+                    c[b] = gf[b] * cPrev[b] + gi[b] * gg[b];
+                    h[b] = go[b] * std::tanh(c[b]);
+                }
+            }
+        }
+
+        return collectOutput(ws.previousHidden, ws.lastHidden);
+    }
+
+    Tensor2<double> accumulateGradients(Workspace& ws, int batch) {
+        ensure(ws.dPackedInput, inputSize, timesteps * batch);
+
+        // Whole-sequence GEMMs instead of one small update per timestep
+        Tensor2<double>::dotInto(ws.dGates, ws.packedInput, dInputWeights, false, true, true);
+        Tensor2<double>::dotInto(ws.dGates, ws.previousHidden, dRecurrentWeights, false, true, true);
+        Tensor2<double>::dotInto(inputWeights, ws.dGates, ws.dPackedInput, true, false);
+        dBiases += Tensor2<double>::sum(ws.dGates, 1);
+
+        return unpackInputGradient(ws.dPackedInput, batch);
+    }
+};
+
+// Gate order in the stacked weights: reset, update, candidate.
+// The candidate uses r * (W_hn h + b_hn), so the recurrent side of all three gates is still one GEMM.
+class GRU : public Recurrent {
+public:
+    GRU(int inputSize, int hiddenSize, int timesteps, bool returnSequences = false)
+        : Recurrent(inputSize, hiddenSize, timesteps, 3, returnSequences) {
+        candidateBiases = Tensor2<double>({ hiddenSize, 1 }, InitType::Random);
+        dCandidateBiases = Tensor2<double>({ hiddenSize, 1 });
+    }
+
+    Tensor2<double> forward(const Tensor2<double>& input, bool training = false) override {
+        if (!training) {
+            return predict(input);
+        }
+
+        model->forwardStack.push(this);
+        return run(input, workspace);
+    }
+
+    Tensor2<double> predict(const Tensor2<double>& input) const override {
+        Workspace local;
+        return run(input, local);
+    }
+
+    Tensor2<double> backward(const Tensor2<double>& dA) override {
+        Workspace& ws = workspace;
+        const int batch = ws.lastHidden.getShape()[1];
+        const int H = hiddenSize;
+
+        ensure(ws.dHidden, H, batch);
+        ensure(ws.dRecurrentStep, 3 * H, batch);
+        ensure(ws.dInputGates, 3 * H, timesteps * batch);
+        ensure(ws.dRecurrentGates, 3 * H, timesteps * batch);
+        zero(ws.dHidden);
+
+        for (int t = timesteps - 1; t >= 0; --t) {
+            const int offset = t * batch;
+            for (int j = 0; j < H; ++j) {
+                const double* gr = ws.gates[j].getData() + offset;
+                const double* gz = ws.gates[H + j].getData() + offset;
+                const double* gn = ws.gates[2 * H + j].getData() + offset;
+                const double* hn = ws.candidateRecurrent[j].getData() + offset;
+                const double* hPrev = ws.previousHidden[j].getData() + offset;
+                const double* dOut = outputGradient(dA, t, j);
+                double* dh = ws.dHidden[j].getData();
+                double* dxr = ws.dInputGates[j].getData() + offset;
+                double* dxz = ws.dInputGates[H + j].getData() + offset;
+                double* dxn = ws.dInputGates[2 * H + j].getData() + offset;
+                double* dhr = ws.dRecurrentStep[j].getData();
+                double* dhz = ws.dRecurrentStep[H + j].getData();
+                double* dhn = ws.dRecurrentStep[2 * H + j].getData();
+                double candidateBiasGrad = 0.0;
+
+                for (int b = 0; b < batch; ++b) {
+                    double dhTotal = dh[b] + (dOut ? dOut[b] : 0.0);
+                    double dnPre = dhTotal * (1.0 - gz[b]) * (1.0 - gn[b] * gn[b]);
+                    double dzPre = dhTotal * (hPrev[b] - gn[b]) * gz[b] * (1.0 - gz[b]);
+                    double drPre = dnPre * hn[b] * gr[b] * (1.0 - gr[b]);
+
+                    dxr[b] = drPre;
+                    dxz[b] = dzPre;
+                    dxn[b] = dnPre;
+                    dhr[b] = drPre;
+                    dhz[b] = dzPre;
+                    dhn[b] = dnPre * gr[b];
+                    candidateBiasGrad += dhn[b];
+                    // Direct path through the update gate; the GEMM below adds the gated path
+                    dh[b] = dhTotal * gz[b];
+                }
+                dCandidateBiases[j][0] += candidateBiasGrad;
+            }
+
+            for (int g = 0; g < 3 * H; ++g) {
+                std::memcpy(ws.dRecurrentGates[g].getData() + offset, ws.dRecurrentStep[g].getData(), sizeof(double) * batch);
+            }
+            Tensor2<double>::dotInto(recurrentWeights, ws.dRecurrentStep, ws.dHidden, true, false, true);
+        }
+
+        ensure(ws.dPackedInput, inputSize, timesteps * batch);
+        Tensor2<double>::dotInto(ws.dInputGates, ws.packedInput, dInputWeights, false, true, true);
+        Tensor2<double>::dotInto(ws.dRecurrentGates, ws.previousHidden, dRecurrentWeights, false, true, true);
+        Tensor2<double>::dotInto(inputWeights, ws.dInputGates, ws.dPackedInput, true, false);
+        dBiases += Tensor2<double>::sum(ws.dInputGates, 1);
+
+        return unpackInputGradient(ws.dPackedInput, batch);
+    }
+
+    std::vector<Parameter> parameters() override {
+        std::vector<Parameter> result = Recurrent::parameters();
+        result.push_back({ &candidateBiases, &dCandidateBiases });
+        return result;
+    }
+
+    Tensor2<double>& getCandidateBiases() {
+        return candidateBiases;
+    }
+
+    // The whole workspace: what the forward saves for BPTT, and the gradient buffers backward
+    // keeps for the next step
+    size_t trainingCacheBytes(int /*inputWidth*/, int batchSize) const override {
+        const size_t sequence = static_cast<size_t>(timesteps) * batchSize;
+        const size_t H = hiddenSize;
+        const size_t forwardBuffers = inputSize * sequence + 2 * 3 * H * sequence + 2 * H * sequence + H * batchSize + 3 * H * batchSize;
+        const size_t backwardBuffers = H * batchSize + 3 * H * batchSize + 2 * 3 * H * sequence + inputSize * sequence;
+        return sizeof(double) * (forwardBuffers + backwardBuffers);
+    }
+
+    void releaseCache() override {
+        workspace = Workspace();
+    }
+
+    Layer* clone() const override {
+        return new GRU(*this);
+    }
+
+private:
+    struct Workspace {
+        Tensor2<double> packedInput;        // inputSize x (T * batch)
+        Tensor2<double> inputProjection;    // 3H x (T * batch)
+        Tensor2<double> gates;              // 3H x (T * batch), activated
+        Tensor2<double> candidateRecurrent; // H x (T * batch), W_hn h + b_hn before the reset gate
+        Tensor2<double> previousHidden;     // H x (T * batch), h(t - 1) in segment t
+        Tensor2<double> lastHidden;         // H x batch
+        Tensor2<double> recurrent;          // 3H x batch
+        Tensor2<double> dHidden;
+        Tensor2<double> dRecurrentStep;
+        Tensor2<double> dInputGates;
+        Tensor2<double> dRecurrentGates;
+        Tensor2<double> dPackedInput;
+    };
+
+    Tensor2<double> candidateBiases;
+    Tensor2<double> dCandidateBiases;
+    Workspace workspace;
+
+    Tensor2<double> run(const Tensor2<double>& input, Workspace& ws) const {
+        checkInput(input);
+        const int batch = input.getShape()[1];
+        const int H = hiddenSize;
+
+        ensure(ws.packedInput, inputSize, timesteps * batch);
+        ensure(ws.inputProjection, 3 * H, timesteps * batch);
+        ensure(ws.gates, 3 * H, timesteps * batch);
+        ensure(ws.candidateRecurrent, H, timesteps * batch);
+        ensure(ws.previousHidden, H, timesteps * batch);
+        ensure(ws.lastHidden, H, batch);
+        ensure(ws.recurrent, 3 * H, batch);
+        zero(ws.lastHidden);
+
+        packInput(input, ws.packedInput);
+        Tensor2<double>::dotInto(inputWeights, ws.packedInput, ws.inputProjection);
+
+        for (int t = 0; t < timesteps; ++t) {
+            const int offset = t * batch;
+            for (int j = 0; j < H; ++j) {
+                std::memcpy(ws.previousHidden[j].getData() + offset, ws.lastHidden[j].getData(), sizeof(double) * batch);
+            }
+            Tensor2<double>::dotInto(recurrentWeights, ws.lastHidden, ws.recurrent);
+
+            for (int j = 0; j < H; ++j) {
+                const double* xr = ws.inputProjection[j].getData() + offset;
+                const double* xz = ws.inputProjection[H + j].getData() + offset;
+                const double* xn = ws.inputProjection[2 * H + j].getData() + offset;
+                const double* rr = ws.recurrent[j].getData();
+                const double* rz = ws.recurrent[H + j].getData();
+                const double* rn = ws.recurrent[2 * H + j].getData();
+                const double br = biases[j][0];
+                const double bz = biases[H + j][0];
+                const double bn = biases[2 * H + j][0];
+                const double bhn = candidateBiases[j][0];
+                double* gr = ws.gates[j].getData() + offset;
+                double* gz = ws.gates[H + j].getData() + offset;
+                double* gn = ws.gates[2 * H + j].getData() + offset;
+                double* hn = ws.candidateRecurrent[j].getData() + offset;
+                double* h = ws.lastHidden[j].getData();
+
+                for (int b = 0; b < batch; ++b) {
+                    gr[b] = sigmoid(xr[b] + rr[b] + br);
+                    gz[b] = sigmoid(xz[b] + rz[b] + bz);
+                    hn[b] = rn[b] + bhn;
+                    gn[b] = std::tanh(xn[b] + bn + gr[b] * hn[b]);
+                    h[b] = (1.0 - gz[b]) * gn[b] + gz[b] * h[b];
+                }
+            }
+        }
+
+        return collectOutput(ws.previousHidden, ws.lastHidden);
+    }
+};
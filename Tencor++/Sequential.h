@@ -4,7 +4,18 @@
 #include "Layer.h"
 #include "Loss.h"
 #include "Model.h"
+#include "Dense.h"
+#include "BatchNorm.h"
+#include "ActivationLayer.h"
+#include "Dropout.h"
+#include "SpscQueue.h"
+#include "MemoryPlan.h"
+#include <memory>
+#include <vector>
+#include <string>
 #include <initializer_list>
+#include <deque>
+#include <atomic>
 
 class Sequential : public Model {
 public:
@@ -24,18 +35,757 @@ public:
 		}
 	}
 
+	// Gradient checkpointing. Consecutive runs of segmentLengths[i] layers (counted after compile's
+	// fusion) become segments: a training forward keeps only each segment's input and frees the
+	// layers' caches, and backward reruns the segment's forward from that input right before its
+	// backward. Layers past the last segment cache as usual; an empty list turns checkpointing off.
+	// With n layers in segments of about sqrt(n), activation memory falls from O(n) to O(sqrt(n))
+	// per sample for roughly one extra forward.
+	void setCheckpointSegments(const std::vector<int>& segmentLengths) {
+		for (int length : segmentLengths) {
+			if (length <= 0) {
+				std::cerr << "Checkpoint segments must hold at least one layer" << std::endl;
+				throw std::invalid_argument("Checkpoint segments must hold at least one layer");
+			}
+		}
+		checkpointLengths = segmentLengths;
+		checkpoints.clear();
+		for (size_t i = 0; i < segmentLengths.size(); ++i) {
+			checkpoints.emplace_back(new Checkpoint(*this));
+		}
+	}
+
+	// Segments of every layers each, covering the whole model
+	void checkpointEvery(int layers) {
+		std::vector<int> lengths;
+		for (int covered = 0; layers > 0 && covered < order.getSize(); covered += layers) {
+			lengths.push_back(layers);
+		}
+		setCheckpointSegments(lengths);
+	}
+
+	// Clones every layer; the replica owns its clones and gives each Dropout its own mask stream
+	Model* replicate(int index, bool sharedParameters = false) const override {
+		Sequential* replica = new Sequential();
+		for (Layer* layer : order) {
+			Layer* copy = sharedParameters ? layer->cloneShared() : layer->clone();
+			if (Dropout* dropout = dynamic_cast<Dropout*>(copy)) {
+				dropout->setStream(static_cast<uint32_t>(index));
+			}
+			replica->owned.emplace_back(copy);
+			replica->add(copy);
+		}
+		replica->setCheckpointSegments(checkpointLengths);
+		return replica;
+	}
+
 	Tensor2<double> forward(Tensor2<double> input, bool training = false) {
+		if (training && !checkpoints.empty()) {
+			return forwardCheckpointed(std::move(input));
+		}
 		Tensor2<double> output = input;
 
 		for (Layer* layer : order) {
+			if (!training && layer->isInferenceIdentity()) {
+				continue;
+			}
 			output = layer->forward(output, training);
 		}
 
 		return output;
 	}
 
+	using Model::predict;
+
+	Tensor2<double> predict(const Tensor2<double>& input) const override {
+		// Read the caller's tensor directly instead of copying it into the loop
+		const Tensor2<double>* current = &input;
+		Tensor2<double> output;
+
+		for (Layer* layer : order) {
+			if (layer->isInferenceIdentity()) {
+				continue;
+			}
+			output = layer->predict(*current);
+			current = &output;
+		}
+
+		if (current == &input) {
+			return input;
+		}
+		return output;
+	}
+
+	// predict, except that the last layer stops before its activation, so a trailing softmax is
+	// never evaluated or stored
+	Tensor2<double> predictLogits(const Tensor2<double>& input) const override {
+		Layer* last = nullptr;
+		for (Layer* layer : order) {
+			if (!layer->isInferenceIdentity()) {
+				last = layer;
+			}
+		}
+
+		const Tensor2<double>* current = &input;
+		Tensor2<double> output;
+		for (Layer* layer : order) {
+			if (layer->isInferenceIdentity()) {
+				continue;
+			}
+			output = layer == last ? layer->predictLogits(*current) : layer->predict(*current);
+			current = &output;
+		}
+
+		if (current == &input) {
+			return input;
+		}
+		return output;
+	}
+
+	// Argmax straight off the last layer's logits; the scan walks rows so each comparison reads
+	// contiguous memory
+	Tensor2<double> predictClasses(const Tensor2<double>& input) const override {
+		Tensor2<double> logits = predictLogits(input);
+		const int rows = logits.shape[0];
+		const int cols = logits.shape[1];
+		Tensor2<double> classes({ 1, cols });
+		std::vector<double> best(logits[0].getData(), logits[0].getData() + cols);
+		double* index = classes[0].getData();
+		for (int i = 1; i < rows; ++i) {
+			const double* row = logits[i].getData();
+			for (int j = 0; j < cols; ++j) {
+				if (row[j] > best[j]) {
+					best[j] = row[j];
+					index[j] = i;
+				}
+			}
+		}
+		return classes;
+	}
+
+	// Fusion pass, run by compile. In order it rewrites:
+	//   Activation -> Activation                one elementwise chain, evaluated in a single pass
+	//   Dense(LINEAR) -> BatchNorm              one Dense (inference only, see foldBatchNorm)
+	//   Dense/BatchNorm(LINEAR) -> Activation   the activation moves into the producing layer
+	//   trailing softmax                        predictClasses takes argmax of the logits (inference only)
+	// Everything fused is also appended to the model's fusion report.
+	FusionReport fuseLayers(bool inference) override {
+		FusionReport report;
+		fuseActivationChains(report);
+		if (inference) {
+			foldBatchNorm(&report);
+		}
+		fuseProducerActivations(report);
+		if (inference) {
+			reportSoftmaxArgmax(report);
+		}
+		fusionReport.merge(report);
+		return report;
+	}
+
+	// Inference-time pass: every Dense(LINEAR) -> BatchNorm pair becomes one Dense whose weights and
+	// biases absorb the normalization, so BatchNorm costs nothing when serving. Returns the pairs folded.
+	// Folded BatchNorm layers are freed when the model owns them, like every layer fusion removes.
+	int foldBatchNorm(FusionReport* report = nullptr) {
+		int folded = 0;
+		Node<Layer*>* node = order.getHead();
+
+		while (node != nullptr && node->next != nullptr) {
+			Dense* dense = dynamic_cast<Dense*>(node->data);
+			BatchNorm* norm = dynamic_cast<BatchNorm*>(node->next->data);
+			if (dense == nullptr || norm == nullptr || dense->getActivation() != LINEAR) {
+				node = node->next;
+				continue;
+			}
+
+			Tensor2<double>& weights = dense->getWeights();
+			Tensor2<double>& biases = dense->getBiases();
+			for (int i = 0; i < weights.getShape()[0]; ++i) {
+				// y = gamma * (Wx + b - mean) / sqrt(var + eps) + beta
+				double scale = norm->getGamma()[i][0] / std::sqrt(norm->getRunningVar()[i][0] + norm->getEpsilon());
+				double* row = weights[i].getData();
+				for (int j = 0; j < weights.getShape()[1]; ++j) {
+					row[j] *= scale;
+				}
+				biases[i][0] = (biases[i][0] - norm->getRunningMean()[i][0]) * scale + norm->getBeta()[i][0];
+			}
+			if (report != nullptr) {
+				report->add(describe(dense) + " -> BatchNorm(" + std::string(activationName(norm->getActivation())) + ")",
+					"Dense(" + std::string(activationName(norm->getActivation())) + ")", sizeof(double) * dense->getOutputSize());
+			}
+			dense->setActivation(norm->getActivation());
+
+			detach(node->next);
+			folded++;
+		}
+
+		return folded;
+	}
+
+	// Pipeline-parallel step with a 1F1B schedule. The layers are cut into contiguous stages of
+	// similar parameter count, one per thread, and the batch is split into column micro-batches that
+	// flow through lock-free queues: activations forwards, input gradients backwards. Stage s keeps at
+	// most stages - s micro-batches in flight and prefers backward work, so every thread stays busy
+	// after the warm-up. Layers cache a single input, so stages other than the last stash only their
+	// input and random state and recompute their forward just before its backward. Each micro-batch's
+	// gradient is weighted by its share of the batch (or of the accumulation group of groupColumns)
+	// when the loss is mean-reduced, so the gradients add up to the whole batch's; so does the
+	// returned loss.
+	double pipelineStep(ThreadPool& pool, Loss<double>& loss, const Tensor2<double>& batchInput,
+	                    const Tensor2<double>& batchTarget, int stages, int microBatches, int groupColumns = 0) override {
+		std::vector<Layer*> layers;
+		for (Layer* layer : order) {
+			layers.push_back(layer);
+		}
+		const int cols = batchInput.getShape()[1];
+		const int wholeColumns = groupColumns > 0 ? groupColumns : cols;
+		stages = std::max(1, std::min({ stages, static_cast<int>(layers.size()), pool.size() }));
+		microBatches = std::max(1, std::min(microBatches, cols));
+		auto microStart = [&](int micro) {
+			return static_cast<int>(static_cast<long long>(cols) * micro / microBatches);
+		};
+
+		// Each stage is a non-owning Sequential so it records its own tape
+		std::vector<int> bounds = partition(layers, stages);
+		std::vector<std::unique_ptr<Sequential>> pipeline;
+		for (int s = 0; s < stages; ++s) {
+			pipeline.emplace_back(new Sequential());
+			for (int i = bounds[s]; i < bounds[s + 1]; ++i) {
+				pipeline[s]->add(layers[i]);
+			}
+		}
+
+		std::vector<std::unique_ptr<SpscQueue<Tensor2<double>>>> activations;
+		std::vector<std::unique_ptr<SpscQueue<Tensor2<double>>>> gradients;
+		for (int s = 0; s + 1 < stages; ++s) {
+			activations.emplace_back(new SpscQueue<Tensor2<double>>(microBatches));
+			gradients.emplace_back(new SpscQueue<Tensor2<double>>(microBatches));
+		}
+		// A failing stage releases the others instead of leaving them waiting on its queue
+		std::atomic<bool> failed(false);
+		auto receive = [&](SpscQueue<Tensor2<double>>& queue) {
+			Tensor2<double> value;
+			while (!queue.tryPop(value)) {
+				if (failed.load(std::memory_order_relaxed)) {
+					throw std::runtime_error("Pipeline stage aborted");
+				}
+				std::this_thread::yield();
+			}
+			return value;
+		};
+		double totalLoss = 0.0;
+
+		auto stageTask = [&](int s) {
+			Sequential& stage = *pipeline[s];
+			const bool first = s == 0;
+			const bool last = s == stages - 1;
+			struct Stashed {
+				Tensor2<double> input;
+				std::vector<uint32_t> randomState;
+			};
+			std::deque<Stashed> stash;
+			int forwarded = 0;
+			int finished = 0;
+
+			while (finished < microBatches) {
+				const bool backwardReady = finished < forwarded && (forwarded == microBatches || forwarded - finished >= stages - s);
+				if (!last && backwardReady) {
+					Tensor2<double> grad = receive(*gradients[s]);
+					Stashed& entry = stash.front();
+					std::vector<uint32_t> current = stage.randomState();
+					std::vector<Tensor2<double>> saved;
+					for (Tensor2<double>* buffer : stage.buffers()) {
+						saved.push_back(*buffer);
+					}
+					// Same masks and same statistics as the original forward, which already updated the buffers
+					stage.setRandomState(entry.randomState);
+					stage.forward(entry.input, true);
+					std::vector<Tensor2<double>*> buffers = stage.buffers();
+					for (size_t i = 0; i < buffers.size(); ++i) {
+						*buffers[i] = saved[i];
+					}
+					stage.setRandomState(current);
+					Tensor2<double> dInput = stage.backpropagate(std::move(grad));
+					if (!first) {
+						gradients[s - 1]->push(std::move(dInput));
+					}
+					stash.pop_front();
+					finished++;
+					continue;
+				}
+
+				Tensor2<double> input = first ? batchInput.slice(microStart(forwarded), microStart(forwarded + 1), 1)
+				                              : receive(*activations[s - 1]);
+				if (last) {
+					Tensor2<double> output = stage.forward(input, true);
+					Tensor2<double> grad;
+					const int width = microStart(forwarded + 1) - microStart(forwarded);
+					totalLoss += loss.forwardBackward(output, batchTarget.slice(microStart(forwarded), microStart(forwarded + 1), 1), grad) * width / cols;
+					loss.weightSliceGradient(grad, wholeColumns);
+					Tensor2<double> dInput = stage.backpropagate(std::move(grad));
+					if (!first) {
+						gradients[s - 1]->push(std::move(dInput));
+					}
+					forwarded++;
+					finished++;
+					continue;
+				}
+
+				stash.push_back({ input, stage.randomState() });
+				Tensor2<double> output = stage.forward(std::move(input), true);
+				while (!stage.forwardStack.isEmpty()) {
+					stage.forwardStack.pop();
+				}
+				activations[s]->push(std::move(output));
+				forwarded++;
+			}
+		};
+
+		try {
+			pool.run(stages, [&](int s) {
+				try {
+					stageTask(s);
+				}
+				catch (...) {
+					failed.store(true);
+					throw;
+				}
+			});
+		}
+		catch (...) {
+			restoreOwnership(layers);
+			throw;
+		}
+		restoreOwnership(layers);
+		return totalLoss;
+	}
+
+	// Largest micro-batch whose training activations fit in cacheBytes (an L2 or L3 size), to pass as
+	// fit's batchSize alongside TrainingOptions::accumulationSteps. Counts the input plus, per layer,
+	// its output and the copy backward keeps.
+	int microBatchSize(int inputSize, size_t cacheBytes) const {
+		size_t bytesPerSample = sizeof(double) * inputSize;
+		int width = inputSize;
+		for (Layer* layer : order) {
+			width = knownWidthAfter(layer, width);
+			bytesPerSample += 2 * sizeof(double) * width;
+		}
+		return static_cast<int>(std::max<size_t>(1, cacheBytes / bytesPerSample));
+	}
+
+	// At inference only a layer's input and output are alive at once, so a chunk fits in cacheBytes
+	// when the widest such pair does
+	int inferenceBatchSize(int inputSize, size_t cacheBytes) const override {
+		int width = inputSize;
+		int widest = inputSize;
+		for (Layer* layer : order) {
+			const int next = widthAfter(layer, width);
+			if (next < 0) {
+				return Model::inferenceBatchSize(inputSize, cacheBytes);
+			}
+			if (!layer->isInferenceIdentity()) {
+				widest = std::max(widest, width + next);
+			}
+			width = next;
+		}
+		return static_cast<int>(std::max<size_t>(1, cacheBytes / (sizeof(double) * widest)));
+	}
+
+	// Lifetimes of every buffer one batch needs, solved into a single slab. With n layers, step i runs
+	// layer i's forward, step n the loss and step 2n - i layer i's backward. Training plans the input,
+	// each layer's output (kept until the next layer's backward has used it), the gradient flowing into
+	// each output, what each layer caches for its backward and the scratch its forward and backward
+	// allocate while they run. Inference plans only
+	// the outputs of the layers that run, each freed once the next layer has read it; the caller's
+	// input is not part of the slab.
+	MemoryPlan planMemory(int inputSize, int batchSize, bool training) const {
+		MemoryPlan plan;
+		const size_t column = sizeof(double) * batchSize;
+
+		if (!training) {
+			int width = inputSize;
+			int step = 0;
+			for (Layer* layer : order) {
+				width = knownWidthAfter(layer, width);
+				if (layer->isInferenceIdentity()) {
+					continue;
+				}
+				plan.add("layer " + std::to_string(step) + " output", column * width, step, step + 1);
+				step++;
+			}
+			plan.solve();
+			return plan;
+		}
+
+		const int n = order.getSize();
+		plan.add("input", column * inputSize, 0, 2 * n);
+		int width = inputSize;
+		int i = 0;
+		for (Layer* layer : order) {
+			const int inputWidth = width;
+			width = knownWidthAfter(layer, width);
+			const std::string name = "layer " + std::to_string(i);
+			const int consumed = i + 1 < n ? 2 * n - (i + 1) : n;
+			plan.add(name + " output", column * width, i, consumed);
+			plan.add(name + " output gradient", column * width, consumed, 2 * n - i);
+			const size_t cache = layer->trainingCacheBytes(inputWidth, batchSize);
+			if (cache > 0) {
+				plan.add(name + " cache", cache, i, 2 * n - i);
+			}
+			const size_t forwardWorkspace = layer->trainingWorkspaceBytes(inputWidth, batchSize, false);
+			if (forwardWorkspace > 0) {
+				plan.add(name + " forward workspace", forwardWorkspace, i, i);
+			}
+			const size_t backwardWorkspace = layer->trainingWorkspaceBytes(inputWidth, batchSize, true);
+			if (backwardWorkspace > 0) {
+				plan.add(name + " backward workspace", backwardWorkspace, 2 * n - i, 2 * n - i);
+			}
+			i++;
+		}
+		plan.solve();
+		return plan;
+	}
+
+	// Preallocated workspace for predict(input, plan): one slab, and a view into it per layer output.
+	// It is the only thing a planned predict writes, so serving threads share one model and keep a
+	// plan each. A default-constructed plan is filled in by its first use.
+	struct InferencePlan {
+		MemoryPlan memory;
+		std::vector<double> slab;
+		std::vector<Tensor2<double>> outputs;
+		int inputSize = 0;
+		int batchSize = 0;
+	};
+
+	InferencePlan planInference(int inputSize, int batchSize) const {
+		InferencePlan plan;
+		plan.memory = planMemory(inputSize, batchSize, false);
+		plan.slab.resize(plan.memory.peakBytes() / sizeof(double));
+		plan.inputSize = inputSize;
+		plan.batchSize = batchSize;
+
+		int width = inputSize;
+		size_t index = 0;
+		const std::vector<MemoryPlan::Buffer>& buffers = plan.memory.getBuffers();
+		for (Layer* layer : order) {
+			width = widthAfter(layer, width);
+			if (layer->isInferenceIdentity()) {
+				continue;
+			}
+			double* memory = plan.slab.data() + buffers[index++].offset / sizeof(double);
+			plan.outputs.push_back(Tensor2<double>::view(memory, width, batchSize));
+		}
+		return plan;
+	}
+
+	// predict with every intermediate written into the plan's slab, so a warm call allocates nothing
+	// in layers that implement predictInto. The plan is redone when the input's shape changes. The
+	// result is a view into the plan, valid until its next use.
+	const Tensor2<double>& predict(const Tensor2<double>& input, InferencePlan& plan) const {
+		if (input.shape[0] != plan.inputSize || input.shape[1] != plan.batchSize) {
+			plan = planInference(input.shape[0], input.shape[1]);
+		}
+
+		const Tensor2<double>* current = &input;
+		size_t index = 0;
+		for (Layer* layer : order) {
+			if (layer->isInferenceIdentity()) {
+				continue;
+			}
+			layer->predictInto(*current, plan.outputs[index]);
+			current = &plan.outputs[index++];
+		}
+		return *current;
+	}
+
 private:
+	// Tape entry standing in for a checkpointed segment. Its backward replays the segment's forward
+	// with the random state and buffers of the original pass, then runs the segment's backward.
+	class Checkpoint : public Layer {
+	public:
+		Checkpoint(Sequential& owner) : owner(owner) {}
+
+		Tensor2<double> forward(const Tensor2<double>& input, bool /*training*/ = false) override {
+			return owner.runSegment(layers, input);
+		}
+
+		Tensor2<double> predict(const Tensor2<double>& input) const override {
+			Tensor2<double> output = input;
+			for (Layer* layer : layers) {
+				output = layer->predict(output);
+			}
+			return output;
+		}
+
+		// Records the segment's input and state before the segment runs
+		void save(const std::vector<Layer*>& segment, const Tensor2<double>& segmentInput) {
+			layers = segment;
+			input = segmentInput;
+			randomState.clear();
+			for (Layer* layer : layers) {
+				randomState.push_back(layer->getRandomState());
+			}
+		}
+
+		Tensor2<double> backward(const Tensor2<double>& dA) override {
+			std::vector<uint32_t> current;
+			std::vector<Tensor2<double>> saved;
+			for (Layer* layer : layers) {
+				current.push_back(layer->getRandomState());
+				for (Tensor2<double>* buffer : layer->buffers()) {
+					saved.push_back(*buffer);
+				}
+			}
+			for (size_t i = 0; i < layers.size(); ++i) {
+				layers[i]->setRandomState(randomState[i]);
+			}
+
+			// The recomputed forward records onto the tape above this entry, and is unwound right away
+			const int depth = owner.forwardStack.getSize();
+			Tensor2<double> x = input;
+			for (Layer* layer : layers) {
+				x = layer->forward(x, true);
+			}
+
+			size_t next = 0;
+			for (size_t i = 0; i < layers.size(); ++i) {
+				layers[i]->setRandomState(current[i]);
+				for (Tensor2<double>* buffer : layers[i]->buffers()) {
+					*buffer = saved[next++];
+				}
+			}
+
+			Tensor2<double> grad = dA;
+			while (owner.forwardStack.getSize() > depth) {
+				grad = owner.forwardStack.pop()->backward(grad);
+			}
+			for (Layer* layer : layers) {
+				layer->releaseCache();
+			}
+			input = Tensor2<double>();
+			return grad;
+		}
+
+		Layer* clone() const override {
+			return new Checkpoint(*this);
+		}
+
+	private:
+		Sequential& owner;
+		std::vector<Layer*> layers;
+		Tensor2<double> input;
+		std::vector<uint32_t> randomState;
+	};
+
 	Loss<double>* lossFunc;
 	List<Layer*> order;
+	// Layers this model created itself (replicas); user-added layers stay owned by the caller
+	std::vector<std::unique_ptr<Layer>> owned;
+	std::vector<int> checkpointLengths;
+	std::vector<std::unique_ptr<Checkpoint>> checkpoints;
+
+	Tensor2<double> forwardCheckpointed(Tensor2<double> input) {
+		std::vector<Layer*> layers;
+		for (Layer* layer : order) {
+			layers.push_back(layer);
+		}
+
+		Tensor2<double> output = std::move(input);
+		size_t next = 0;
+		for (size_t s = 0; s < checkpoints.size() && next < layers.size(); ++s) {
+			const size_t end = std::min(layers.size(), next + checkpointLengths[s]);
+			std::vector<Layer*> segment(layers.begin() + next, layers.begin() + end);
+			checkpoints[s]->save(segment, output);
+			output = runSegment(segment, output);
+			for (Layer* layer : segment) {
+				layer->releaseCache();
+			}
+			forwardStack.push(checkpoints[s].get());
+			next = end;
+		}
+		for (; next < layers.size(); ++next) {
+			output = layers[next]->forward(output, true);
+		}
+		return output;
+	}
+
+	// Training forward over the segment, leaving nothing on the tape
+	Tensor2<double> runSegment(const std::vector<Layer*>& segment, Tensor2<double> x) {
+		const int depth = forwardStack.getSize();
+		for (Layer* layer : segment) {
+			x = layer->forward(x, true);
+		}
+		while (forwardStack.getSize() > depth) {
+			forwardStack.pop();
+		}
+		return x;
+	}
+
+	// Unlinks a layer fused into its neighbour and frees it if this model owns it (see owned);
+	// a layer the caller added stays the caller's to free
+	void detach(Node<Layer*>* node) {
+		Layer* layer = node->data;
+		removeLayer(layer);
+		order.remove(node);
+		for (size_t i = 0; i < owned.size(); ++i) {
+			if (owned[i].get() == layer) {
+				owned.erase(owned.begin() + i);
+				break;
+			}
+		}
+	}
+
+	// Layer index where each stage starts, plus the end. Stages are contiguous and cut where the running
+	// cost (parameter elements, plus one per layer so parameter-free layers still count) first reaches
+	// an equal share, keeping at least one layer per stage.
+	static std::vector<int> partition(const std::vector<Layer*>& layers, int stages) {
+		std::vector<double> prefix(1, 0.0);
+		for (Layer* layer : layers) {
+			double cost = 1.0;
+			for (const Parameter& parameter : layer->parameters()) {
+				cost += static_cast<double>(parameter.value->getShape()[0]) * parameter.value->getShape()[1];
+			}
+			prefix.push_back(prefix.back() + cost);
+		}
+
+		const int count = static_cast<int>(layers.size());
+		std::vector<int> bounds(1, 0);
+		for (int s = 1; s < stages; ++s) {
+			const double share = prefix.back() * s / stages;
+			int cut = bounds.back() + 1;
+			while (cut < count - (stages - s) && prefix[cut] < share) {
+				cut++;
+			}
+			bounds.push_back(cut);
+		}
+		bounds.push_back(count);
+		return bounds;
+	}
+
+	std::vector<uint32_t> randomState() const {
+		std::vector<uint32_t> state;
+		for (Layer* layer : order) {
+			state.push_back(layer->getRandomState());
+		}
+		return state;
+	}
+
+	void setRandomState(const std::vector<uint32_t>& state) {
+		int i = 0;
+		for (Layer* layer : order) {
+			layer->setRandomState(state[i++]);
+		}
+	}
+
+	void restoreOwnership(const std::vector<Layer*>& layers) {
+		for (Layer* layer : layers) {
+			layer->setModel(this);
+		}
+	}
+
+	static std::string describe(Dense* dense) {
+		return "Dense(" + std::to_string(dense->getWeights().getShape()[1]) + "->" + std::to_string(dense->getOutputSize()) +
+			", " + activationName(dense->getActivation()) + ")";
+	}
+
+	static std::string describe(const ActivationLayer* activation) {
+		std::string stages;
+		for (Activation stage : activation->getActivations()) {
+			stages += stages.empty() ? activationName(stage) : std::string(", ") + activationName(stage);
+		}
+		return "Activation(" + stages + ")";
+	}
+
+	// Rows flowing out of each node; -1 from the first layer whose width cannot be told onwards.
+	// Fusion reports count such widths as 0 bytes.
+	static int widthAfter(const Layer* layer, int width) {
+		return layer->getOutputWidth(width);
+	}
+
+	// Sizes derived from an unknown width would be garbage, so planning refuses instead
+	static int knownWidthAfter(const Layer* layer, int width) {
+		const int next = widthAfter(layer, width);
+		if (next < 0) {
+			std::cerr << "Cannot plan memory: a layer's output width is unknown before it runs" << std::endl;
+			throw std::invalid_argument("Cannot plan memory: a layer's output width is unknown before it runs");
+		}
+		return next;
+	}
+
+	void fuseActivationChains(FusionReport& report) {
+		Node<Layer*>* node = order.getHead();
+		int width = 0;
+
+		while (node != nullptr) {
+			width = std::max(widthAfter(node->data, width), 0);
+			ActivationLayer* first = dynamic_cast<ActivationLayer*>(node->data);
+			ActivationLayer* second = node->next != nullptr ? dynamic_cast<ActivationLayer*>(node->next->data) : nullptr;
+			if (first == nullptr || second == nullptr) {
+				node = node->next;
+				continue;
+			}
+
+			std::string pattern = describe(first) + " -> " + describe(second);
+			if (!first->absorb(*second)) {
+				node = node->next;
+				continue;
+			}
+			report.add(pattern, describe(first), sizeof(double) * width);
+			detach(node->next);
+		}
+	}
+
+	void fuseProducerActivations(FusionReport& report) {
+		Node<Layer*>* node = order.getHead();
+		int width = 0;
+
+		while (node != nullptr) {
+			width = std::max(widthAfter(node->data, width), 0);
+			ActivationLayer* activation = node->next != nullptr ? dynamic_cast<ActivationLayer*>(node->next->data) : nullptr;
+			if (activation == nullptr || activation->getActivations().size() != 1) {
+				node = node->next;
+				continue;
+			}
+
+			Activation stage = activation->getActivations()[0];
+			if (Dense* dense = dynamic_cast<Dense*>(node->data)) {
+				if (dense->getActivation() == LINEAR) {
+					report.add(describe(dense) + " -> " + describe(activation), "Dense(" + std::string(activationName(stage)) + ")", sizeof(double) * width);
+					dense->setActivation(stage);
+					detach(node->next);
+					continue;
+				}
+			}
+			else if (BatchNorm* norm = dynamic_cast<BatchNorm*>(node->data)) {
+				if (norm->getActivation() == LINEAR) {
+					report.add("BatchNorm(LINEAR) -> " + describe(activation), "BatchNorm(" + std::string(activationName(stage)) + ")", sizeof(double) * width);
+					norm->setActivation(stage);
+					detach(node->next);
+					continue;
+				}
+			}
+			node = node->next;
+		}
+	}
+
+	void reportSoftmaxArgmax(FusionReport& report) const {
+		Layer* last = nullptr;
+		int width = 0;
+		for (Layer* layer : order) {
+			width = std::max(widthAfter(layer, width), 0);
+			if (!layer->isInferenceIdentity()) {
+				last = layer;
+			}
+		}
+
+		Dense* dense = dynamic_cast<Dense*>(last);
+		ActivationLayer* activation = dynamic_cast<ActivationLayer*>(last);
+		if (dense != nullptr && dense->getActivation() == SOFTMAX) {
+			report.add(describe(dense) + " -> argmax", "argmax over logits in predictClasses", sizeof(double) * width);
+		}
+		else if (activation != nullptr && activation->getActivations().back() == SOFTMAX) {
+			report.add(describe(activation) + " -> argmax", "argmax over logits in predictClasses", sizeof(double) * width);
+		}
+	}
 };
 
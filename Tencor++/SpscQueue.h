@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <cstddef>
+
+// Bounded single-producer single-consumer ring. Exactly one thread may push and exactly one may pop;
+// the two sides only share the head and tail counters, each written by one side, so no locks are taken.
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) : head(0), tail(0) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Leaves value untouched and returns false when the ring is full
+    bool tryPush(T&& value) {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == slots.size()) {
+            return false;
+        }
+        slots[t & mask] = std::move(value);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T& value) {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = std::move(slots[h & mask]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Blocking variants spin with yield; the queues are meant for threads that are busy anyway
+    void push(T&& value) {
+        while (!tryPush(std::move(value))) {
+            std::this_thread::yield();
+        }
+    }
+
+    T pop() {
+        T value;
+        while (!tryPop(value)) {
+            std::this_thread::yield();
+        }
+        return value;
+    }
+
+    size_t capacity() const {
+        return slots.size();
+    }
+
+private:
+    std::vector<T> slots;
+    size_t mask;
+    // Separate cache lines so the producer and consumer do not invalidate each other's counter
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+};
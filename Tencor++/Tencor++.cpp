@@ -4,10 +4,15 @@
 #include <string>
 #include <fstream>
 #include <stdexcept>
+#include <chrono>
+#include <thread>
+#include <algorithm>
 #include <opencv2/opencv.hpp>
 
 #include "Sequential.h"
 #include "Dense.h"
+#include "Conv2D.h"
+#include "Pooling.h"
 #include "Loss.h"
 #include "ModelSaver.h"
 #include "MNISTDataLoader.h"
@@ -73,6 +78,130 @@ void verifyWeightsAndBiases(const std::string& weightsFile, const std::string& b
     }
 }
 
+double evaluateAccuracy(const Model& model, const Tensor2<double>& images, const Tensor2<double>& labels) {
+    Tensor2<double> predictedClasses = model.predictClasses(images);
+    int correct = 0;
+    for (int i = 0; i < labels.getShape()[1]; i++) {
+        if (predictedClasses({ 0, i }) == labels({ 0, i })) {
+            correct++;
+        }
+    }
+    return static_cast<double>(correct) / labels.getShape()[1];
+}
+
+// Trains one epoch at a time until the held-out accuracy reaches the target, returning seconds spent in fit
+double trainToAccuracy(Model& model, const Tensor2<double>& trainX, const Tensor2<double>& trainY,
+                       const Tensor2<double>& testX, const Tensor2<double>& testLabels,
+                       double targetAccuracy, int maxEpochs, double learningRate, int batchSize, double& accuracy, int& epochsUsed) {
+    double seconds = 0.0;
+    accuracy = 0.0;
+    for (epochsUsed = 1; epochsUsed <= maxEpochs; epochsUsed++) {
+        auto start = std::chrono::steady_clock::now();
+        model.fit(trainX, trainY, 1, learningRate, batchSize);
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        accuracy = evaluateAccuracy(model, testX, testLabels);
+        if (accuracy >= targetAccuracy) {
+            break;
+        }
+    }
+    return seconds;
+}
+
+// Compares the flattened Dense MLP against a small convolutional model on the same MNIST split
+void ConvBenchmark() {
+    std::string trainImagesPath = "C:\\Users\\USMAN-PC\\Desktop\\Tencor\\mnist\\train-images.idx3-ubyte";
+    std::string trainLabelsPath = "C:\\Users\\USMAN-PC\\Desktop\\Tencor\\mnist\\train-labels.idx1-ubyte";
+    MNISTDataLoader loader(trainImagesPath, trainLabelsPath);
+    loader.normalizeImages();
+
+    Tensor2<double> images = Tensor2<double>::transpose(loader.getImages().flatten(1));
+    Tensor2<double> labels = loader.getLabels().squeeze();
+    int samples = images.getShape()[1];
+    int trainSamples = samples * 4 / 5;
+
+    Tensor2<double> trainX = images.slice(0, trainSamples, 1);
+    Tensor2<double> trainY = oneHotEncode(labels.slice(0, trainSamples, 1), 10);
+    Tensor2<double> testX = images.slice(trainSamples, samples, 1);
+    Tensor2<double> testLabels = labels.slice(trainSamples, samples, 1);
+
+    const double targetAccuracy = 0.85;
+    const int maxEpochs = 30;
+
+    Sequential mlp;
+    mlp.add({ new Dense(784, 128, Activation::RELU), new Dense(128, 64, Activation::RELU), new Dense(64, 10, Activation::SOFTMAX) });
+    mlp.compile(new CategoricalCrossEntropy<double>());
+
+    // 1x28x28 -> 8x14x14 -> 16x7x7 -> 10
+    Sequential cnn;
+    cnn.add({ new Conv2D(1, 28, 28, 8, 3, 2, 1, Activation::RELU), new Conv2D(8, 14, 14, 16, 3, 2, 1, Activation::RELU), new Dense(784, 10, Activation::SOFTMAX) });
+    cnn.compile(new CategoricalCrossEntropy<double>());
+
+    // 1x28x28 -> 8x28x28 -> 8x14x14 -> 16x14x14 -> 16x7x7 -> 10, stride-1 3x3 kernels use the direct path
+    Sequential pooled;
+    pooled.add({ new Conv2D(1, 28, 28, 8, 3, 1, 1, Activation::RELU), new MaxPool2D(8, 28, 28, 2),
+                 new Conv2D(8, 14, 14, 16, 3, 1, 1, Activation::RELU), new MaxPool2D(16, 14, 14, 2),
+                 new Dense(784, 10, Activation::SOFTMAX) });
+    pooled.compile(new CategoricalCrossEntropy<double>());
+
+    double mlpAccuracy, cnnAccuracy, pooledAccuracy;
+    int mlpEpochs, cnnEpochs, pooledEpochs;
+    double mlpSeconds = trainToAccuracy(mlp, trainX, trainY, testX, testLabels, targetAccuracy, maxEpochs, 0.01, 10, mlpAccuracy, mlpEpochs);
+    double cnnSeconds = trainToAccuracy(cnn, trainX, trainY, testX, testLabels, targetAccuracy, maxEpochs, 0.01, 10, cnnAccuracy, cnnEpochs);
+    double pooledSeconds = trainToAccuracy(pooled, trainX, trainY, testX, testLabels, targetAccuracy, maxEpochs, 0.01, 10, pooledAccuracy, pooledEpochs);
+
+    std::cout << "Dense MLP: " << 784 * 128 + 128 + 128 * 64 + 64 + 64 * 10 + 10 << " parameters, "
+              << mlpEpochs << " epochs, " << mlpSeconds << " s, accuracy " << mlpAccuracy * 100 << "%" << std::endl;
+    std::cout << "Conv2D:    " << 8 * 9 + 8 + 16 * 8 * 9 + 16 + 784 * 10 + 10 << " parameters, "
+              << cnnEpochs << " epochs, " << cnnSeconds << " s, accuracy " << cnnAccuracy * 100 << "%" << std::endl;
+    std::cout << "Conv+Pool: " << 8 * 9 + 8 + 16 * 8 * 9 + 16 + 784 * 10 + 10 << " parameters, "
+              << pooledEpochs << " epochs, " << pooledSeconds << " s, accuracy " << pooledAccuracy * 100 << "%" << std::endl;
+}
+
+// Trains the same MLP with synchronous data-parallel steps and with Hogwild, reporting throughput and accuracy per epoch
+void HogwildBenchmark() {
+    std::string trainImagesPath = "C:\\Users\\USMAN-PC\\Desktop\\Tencor\\mnist\\train-images.idx3-ubyte";
+    std::string trainLabelsPath = "C:\\Users\\USMAN-PC\\Desktop\\Tencor\\mnist\\train-labels.idx1-ubyte";
+    MNISTDataLoader loader(trainImagesPath, trainLabelsPath);
+    loader.normalizeImages();
+
+    Tensor2<double> images = Tensor2<double>::transpose(loader.getImages().flatten(1));
+    Tensor2<double> labels = loader.getLabels().squeeze();
+    int samples = images.getShape()[1];
+    int trainSamples = samples * 4 / 5;
+
+    Tensor2<double> trainX = images.slice(0, trainSamples, 1);
+    Tensor2<double> trainY = oneHotEncode(labels.slice(0, trainSamples, 1), 10);
+    Tensor2<double> testX = images.slice(trainSamples, samples, 1);
+    Tensor2<double> testLabels = labels.slice(trainSamples, samples, 1);
+
+    const int threads = std::max(2, static_cast<int>(std::thread::hardware_concurrency()));
+    const int epochs = 5;
+
+    for (int mode = 0; mode < 2; mode++) {
+        srand(42);
+        Sequential mlp;
+        mlp.add({ new Dense(784, 128, Activation::RELU), new Dense(128, 64, Activation::RELU), new Dense(64, 10, Activation::SOFTMAX) });
+        mlp.compile(new CategoricalCrossEntropy<double>());
+
+        TrainingOptions options;
+        options.threads = threads;
+        options.asynchronous = mode == 1;
+        const char* name = options.asynchronous ? "Hogwild    " : "Synchronous";
+
+        double seconds = 0.0;
+        for (int epoch = 1; epoch <= epochs; epoch++) {
+            auto start = std::chrono::steady_clock::now();
+            mlp.fit(trainX, trainY, 1, 0.01, 32, options);
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            std::cout << name << " epoch " << epoch << ": " << seconds << " s total, "
+                      << trainSamples * epoch / seconds << " samples/s, accuracy "
+                      << evaluateAccuracy(mlp, testX, testLabels) * 100 << "%" << std::endl;
+        }
+    }
+}
+
 void MNISTTest() {
     std::string trainImagesPath = "C:\\Users\\USMAN-PC\\Desktop\\Tencor\\mnist\\train-images.idx3-ubyte";
     std::string trainLabelsPath = "C:\\Users\\USMAN-PC\\Desktop\\Tencor\\mnist\\train-labels.idx1-ubyte";
@@ -98,8 +227,8 @@ void MNISTTest() {
 
     std::cout << "Layers added to Sequential model" << std::endl;
 
-    // Compile the model
-    model.compile(new CategoricalCrossEntropy<double>());
+    // Compile the model; Adam converges in far fewer epochs than plain SGD at this learning rate
+    model.compile(new CategoricalCrossEntropy<double>(), new Adam());
 
     // Flatten and preprocess data
     Tensor2<double> flattenedImages = testLoader.getImages().flatten(1);
@@ -246,6 +375,115 @@ void MNISTTest() {
 
 #include <iomanip> // For std::setw and std::setprecision
 
+// Copies out every parameter gradient the model has accumulated and clears them
+std::vector<Tensor2<double>> takeGradients(Model& model) {
+    std::vector<Tensor2<double>> result;
+    for (Parameter& parameter : model.parameters()) {
+        result.push_back(*parameter.grad);
+        *parameter.grad = Tensor2<double>(parameter.grad->getShape());
+    }
+    return result;
+}
+
+double largestDifference(const std::vector<Tensor2<double>>& a, const std::vector<Tensor2<double>>& b) {
+    double largest = 0.0;
+    for (size_t p = 0; p < a.size(); p++) {
+        for (int i = 0; i < a[p].getShape()[0]; i++) {
+            for (int j = 0; j < a[p].getShape()[1]; j++) {
+                largest = std::max(largest, std::abs(a[p][i][j] - b[p][i][j]));
+            }
+        }
+    }
+    return largest;
+}
+
+// A pipelined step must produce the loss and gradients of one plain step over the same batch,
+// whatever the loss's reduction; the four micro-batches here are of unequal width (2, 3, 2, 3 columns)
+void PipelineGradientTest() {
+    MeanSquaredError<double> mse;
+    BinaryCrossEntropy<double> bce;
+    CategoricalCrossEntropy<double> cce;
+    std::vector<std::pair<std::string, Loss<double>*>> losses = { { "MSE", &mse }, { "BCE", &bce }, { "CCE", &cce } };
+    std::vector<Activation> outputs = { LINEAR, SIGMOID, SOFTMAX };
+    ThreadPool pool(2);
+
+    for (size_t l = 0; l < losses.size(); l++) {
+        srand(7);
+        Dense hidden(4, 5, TANH);
+        Dense last(5, 3, outputs[l]);
+        Sequential model;
+        model.add({ &hidden, &last });
+
+        Tensor2<double> input({ 4, 10 }, InitType::Random);
+        Tensor2<double> target({ 3, 10 });
+        for (int j = 0; j < 10; j++) {
+            target({ j % 3, j }) = 1.0;
+        }
+
+        Tensor2<double> grad;
+        double plainLoss = losses[l].second->forwardBackward(model.forward(input, true), target, grad);
+        model.backpropagate(std::move(grad));
+        std::vector<Tensor2<double>> plain = takeGradients(model);
+
+        double pipelineLoss = model.pipelineStep(pool, *losses[l].second, input, target, 2, 4);
+        std::vector<Tensor2<double>> pipelined = takeGradients(model);
+
+        double difference = largestDifference(plain, pipelined);
+        bool passed = difference < 1e-12 && std::abs(plainLoss - pipelineLoss) < 1e-12;
+        std::cout << losses[l].first << " pipeline gradient difference " << difference << ", loss " << pipelineLoss
+                  << " vs " << plainLoss << (passed ? " (passed)" : " (FAILED)") << std::endl;
+    }
+}
+
+// One epoch in batches of 3 accumulated 4 at a time (3 + 3 + 3 + 1 columns) must make the same update
+// as one batch of all 10 columns, whether the batches run plainly, data-parallel or pipelined
+void AccumulationGradientTest() {
+    MeanSquaredError<double> mse;
+    BinaryCrossEntropy<double> bce;
+    CategoricalCrossEntropy<double> cce;
+    std::vector<std::pair<std::string, Loss<double>*>> losses = { { "MSE", &mse }, { "BCE", &bce }, { "CCE", &cce } };
+    std::vector<Activation> outputs = { LINEAR, SIGMOID, SOFTMAX };
+    std::vector<std::string> modes = { "plain", "data-parallel", "pipelined" };
+
+    for (size_t l = 0; l < losses.size(); l++) {
+        srand(11);
+        Tensor2<double> input({ 4, 10 }, InitType::Random);
+        Tensor2<double> target({ 3, 10 });
+        for (int j = 0; j < 10; j++) {
+            target({ j % 3, j }) = 1.0;
+        }
+
+        auto train = [&](int batchSize, int accumulationSteps, int mode) {
+            srand(7);
+            Dense hidden(4, 5, TANH);
+            Dense last(5, 3, outputs[l]);
+            Sequential model;
+            model.add({ &hidden, &last });
+            model.compile(losses[l].second, nullptr, false);
+
+            TrainingOptions options;
+            options.reporting = ReportMode::Silent;
+            options.accumulationSteps = accumulationSteps;
+            options.threads = mode == 1 ? 2 : 1;
+            options.pipelineStages = mode == 2 ? 2 : 1;
+            model.fit(input, target, 1, 0.1, batchSize, options);
+
+            std::vector<Tensor2<double>> weights;
+            for (Parameter& parameter : model.parameters()) {
+                weights.push_back(*parameter.value);
+            }
+            return weights;
+        };
+
+        std::vector<Tensor2<double>> whole = train(10, 1, 0);
+        for (size_t mode = 0; mode < modes.size(); mode++) {
+            double difference = largestDifference(whole, train(3, 4, static_cast<int>(mode)));
+            std::cout << losses[l].first << " accumulated " << modes[mode] << " weight difference " << difference
+                      << (difference < 1e-12 ? " (passed)" : " (FAILED)") << std::endl;
+        }
+    }
+}
+
 void PredictTest() {
     try {
         // Paths to test dataset
@@ -283,8 +521,11 @@ void PredictTest() {
         Tensor2<double> flattenedImages = testLoader.getImages().flatten(1);
         flattenedImages = Tensor2<double>::transpose(flattenedImages);
 
-        // Run predictions
-        Tensor2<double> predictions = model.forward(flattenedImages);
+        // Run predictions in cache-sized chunks on every core, keeping only the predicted class
+        PredictOptions predictOptions;
+        predictOptions.threads = std::max(1u, std::thread::hardware_concurrency());
+        predictOptions.output = PredictOutput::Classes;
+        Tensor2<double> predictions = model.predict(flattenedImages, 0, predictOptions);
 
         // Calculate accuracy
         int validPredictions = 0;
@@ -293,17 +534,7 @@ void PredictTest() {
         int progressBarWidth = 50; // Width of the progress bar
 
         for (int i = 0; i < totalSamples; i++) {
-            // Find the class with the highest probability
-            int predictedClass = -1;
-            double maxProb = -1.0;
-
-            for (int c = 0; c < 10; c++) {
-                double prob = predictions({c, i});
-                if (!std::isnan(prob) && prob > maxProb) {
-                    maxProb = prob;
-                    predictedClass = c;
-                }
-            }
+            int predictedClass = static_cast<int>(predictions({ 0, i }));
 
             // Get the actual label
             int actualLabel = static_cast<int>(testLoader.getLabels()({i, 0}));
@@ -377,7 +608,7 @@ void predictAndDisplayMNIST() {
     //std::cout << "Test data prepared for prediction." << std::endl;  
 
     // Perform prediction  
-    Tensor2<double> output = model.forward(test);  
+    Tensor2<double> output = model.predict(test);  
 
     // Get predicted classes   
     Tensor2<double> predictedClasses = Tensor2<double>::argmax(output, 0);   
@@ -431,6 +662,10 @@ void predictAndDisplayMNIST() {
 int main() {
     try {
         //MNISTTest();
+        //ConvBenchmark();
+        //HogwildBenchmark();
+        PipelineGradientTest();
+        AccumulationGradientTest();
         PredictTest();
         predictAndDisplayMNIST();
     } catch (const std::exception& ex) {
@@ -4,6 +4,8 @@
 #include <initializer_list>
 #include <cassert>
 #include <cmath>
+#include <utility>
+#include <algorithm>
 
 template <typename T> class Tensor1;
 template <typename T> class Tensor2;
@@ -95,12 +97,34 @@ public:
 
     Tensor1(const Tensor1& other) : Tensor<T>(other.shape)
     {
+        // Copying a default-constructed (empty) tensor yields another empty tensor
+        if (other.shape.empty()) {
+            return;
+        }
         data = new T[other.shape[0]];
         for (int i = 0; i < other.shape[0]; ++i) {
             data[i] = other.data[i];
         }
     }
 
+    Tensor1(Tensor1&& other) noexcept
+    {
+        this->shape = std::move(other.shape);
+        data = other.data;
+        ownsData = other.ownsData;
+        other.data = nullptr;
+    }
+
+    // Non-owning row over memory someone else manages (a planned slab); it must outlive the view.
+    // Copy-assigning a tensor of another shape detaches the view into ordinary owned storage.
+    static Tensor1 view(T* memory, int size) {
+        Tensor1 result;
+        result.shape = { size };
+        result.data = memory;
+        result.ownsData = false;
+        return result;
+    }
+
 	// Add this constructor to Tensor1D class
 	Tensor1(std::initializer_list<T> values) : Tensor<T>({ static_cast<int>(values.size()) }) {
 		data = new T[values.size()];
@@ -111,17 +135,31 @@ public:
 	}
 
     ~Tensor1() {
-        delete[] data;
+        if (ownsData) {
+            delete[] data;
+        }
     }
 
     Tensor1& operator=(const Tensor1& other) {
         if (this == &other) {
             return *this;
         }
+        // A view keeps pointing at its memory when the shapes agree
+        if (!ownsData && this->shape == other.shape) {
+            std::copy(other.data, other.data + other.shape[0], data);
+            return *this;
+        }
 
-        delete[] data;
+        if (ownsData) {
+            delete[] data;
+        }
+        data = nullptr;
+        ownsData = true;
 
         this->shape = other.shape;
+        if (other.shape.empty()) {
+            return *this;
+        }
         data = new T[other.shape[0]];
         for (int i = 0; i < other.shape[0]; ++i) {
             data[i] = other.data[i];
@@ -130,6 +168,15 @@ public:
         return *this;
     }
 
+    Tensor1& operator=(Tensor1&& other) noexcept {
+        if (this != &other) {
+            std::swap(this->shape, other.shape);
+            std::swap(data, other.data);
+            std::swap(ownsData, other.ownsData);
+        }
+        return *this;
+    }
+
 	T& operator()(const std::vector<int>& indices) {
         return data[indices[0]];
     }
@@ -150,6 +197,19 @@ public:
 		return data[index];
 	}
 
+	const T& operator[] (int index) const {
+		return data[index];
+	}
+
+	// Contiguous element storage, for kernels that walk a whole row
+	T* getData() {
+		return data;
+	}
+
+	const T* getData() const {
+		return data;
+	}
+
     Tensor1 operator+(const Tensor1& other) const {
         if (this->shape == other.shape) {
 			Tensor1 result(this->shape);
@@ -424,6 +484,7 @@ public:
 
 private:
     T* data = nullptr;
+    bool ownsData = true;
 
     static Tensor1<T> dotProjected(const Tensor1<T>& t1, const Tensor1<T>& t2) {
         Tensor1<T> result(t1.shape);
@@ -449,12 +510,23 @@ public:
 
 	Tensor2(const Tensor2& other) : Tensor<T>(other.shape)
 	{
+		// Copying a default-constructed (empty) tensor yields another empty tensor
+		if (other.shape.empty()) {
+			return;
+		}
 		data = new Tensor1<T>[other.shape[0]];
 		for (int i = 0; i < other.shape[0]; ++i) {
 			data[i] = other.data[i];
 		}
 	}
 
+	Tensor2(Tensor2&& other) noexcept
+	{
+		this->shape = std::move(other.shape);
+		data = other.data;
+		other.data = nullptr;
+	}
+
 	Tensor2(std::initializer_list<std::initializer_list<T>> values) : Tensor<T>({ static_cast<int>(values.size()), static_cast<int>(values.begin()->size()) }) {
 		data = new Tensor1<T>[values.size()];
 		int i = 0;
@@ -483,6 +555,28 @@ public:
 		delete[] data;
 	}
 
+	// rows x cols tensor whose rows are views into memory (row-major, rows * cols elements)
+	static Tensor2 view(T* memory, int rows, int cols) {
+		Tensor2 result;
+		result.shape = { rows, cols };
+		result.data = new Tensor1<T>[rows];
+		for (int i = 0; i < rows; ++i) {
+			result.data[i] = Tensor1<T>::view(memory + static_cast<size_t>(i) * cols, cols);
+		}
+		return result;
+	}
+
+	// Same shape as source, each row a view of source's row: reads and writes go to source's storage
+	static Tensor2 view(Tensor2& source) {
+		Tensor2 result;
+		result.shape = source.shape;
+		result.data = new Tensor1<T>[source.shape[0]];
+		for (int i = 0; i < source.shape[0]; ++i) {
+			result.data[i] = Tensor1<T>::view(source.data[i].getData(), source.shape[1]);
+		}
+		return result;
+	}
+
 	bool operator==(const Tensor2<T>& other) const {
 
         if (this->shape != other.shape) return false;
@@ -507,8 +601,12 @@ public:
 		}
 
 		delete[] data;
+		data = nullptr;
 
 		this->shape = other.shape;
+		if (other.shape.empty()) {
+			return *this;
+		}
 		data = new Tensor1<T>[other.shape[0]];
 		for (int i = 0; i < other.shape[0]; ++i) {
 			data[i] = other.data[i];
@@ -517,6 +615,14 @@ public:
 		return *this;
 	}
 
+	Tensor2& operator=(Tensor2&& other) noexcept {
+		if (this != &other) {
+			std::swap(this->shape, other.shape);
+			std::swap(data, other.data);
+		}
+		return *this;
+	}
+
 	T& operator()(const std::vector<int>& indices) override {
 		return data[indices[0]]({ indices[1] });
 	}
@@ -536,6 +642,10 @@ public:
 		return data[index];
 	}
 
+	const Tensor1<T>& operator[] (int index) const {
+		return data[index];
+	}
+
 	Tensor2 operator+(const Tensor2& other) const {
 
 		std::vector<int> resultDimensions;
@@ -797,7 +907,28 @@ public:
 			throw std::invalid_argument("Invalid axis");
 		}
 	}
-	
+
+	// out = columns indices[start..end) of this tensor, packed contiguously; out is reallocated only when
+	// its shape differs. Builds shuffled minibatches without reordering the dataset: the index block is
+	// reused by every row and stays in L1, and the inner loop is an independent gather per element,
+	// which compilers turn into vector gathers where the target has them.
+	void gatherColumns(const std::vector<int>& indices, int start, int end, Tensor2& out) const {
+		const int rows = this->shape[0];
+		const int width = end - start;
+		if (out.shape.size() != 2 || out.shape[0] != rows || out.shape[1] != width) {
+			out = Tensor2({ rows, width });
+		}
+
+		const int* index = indices.data() + start;
+		for (int i = 0; i < rows; ++i) {
+			const T* src = data[i].getData();
+			T* dst = out.data[i].getData();
+			for (int k = 0; k < width; ++k) {
+				dst[k] = src[index[k]];
+			}
+		}
+	}
+
 
 
 
@@ -812,18 +943,88 @@ public:
 		}
 
 		Tensor2<T> result({ tensor1.shape[0], tensor2.shape[1] });
+		dotInto(t1, t2, result, false, false, true);
 
-		for (int i = 0; i < tensor1.shape[0]; ++i) {
-			for (int j = 0; j < tensor2.shape[1]; ++j) {
-				T sum = 0;
-				for (int k = 0; k < tensor1.shape[1]; ++k) {
-					sum += t1({ i, k }) * t2({ k, j });
+		return result;
+	}
+
+	// op(t1) . op(t2) without materializing the transposed operand
+	static Tensor2<T> dot(const Tensor2<T>& t1, const Tensor2<T>& t2, bool transpose1, bool transpose2) {
+		Tensor2<T> result({ transpose1 ? t1.shape[1] : t1.shape[0], transpose2 ? t2.shape[0] : t2.shape[1] });
+		dotInto(t1, t2, result, transpose1, transpose2, true);
+
+		return result;
+	}
+
+	// Writes (or with accumulate, adds) op(t1) . op(t2) into an existing result, so hot loops can reuse buffers
+	static void dotInto(const Tensor2<T>& t1, const Tensor2<T>& t2, Tensor2<T>& result, bool transpose1 = false, bool transpose2 = false, bool accumulate = false) {
+		if (transpose1 && transpose2) {
+			dotInto(transpose(t1), t2, result, false, true, accumulate);
+			return;
+		}
+
+		const int rows = transpose1 ? t1.shape[1] : t1.shape[0];
+		const int inner = transpose1 ? t1.shape[0] : t1.shape[1];
+		const int cols = transpose2 ? t2.shape[0] : t2.shape[1];
+		if (inner != (transpose2 ? t2.shape[1] : t2.shape[0])) {
+			std::cerr << "Dimension mismath!\n";
+			throw std::invalid_argument("Dimensions must match for dot product");
+		}
+		if (result.shape.size() != 2 || result.shape[0] != rows || result.shape[1] != cols) {
+			std::cerr << "Result shape does not match dot product\n";
+			throw std::invalid_argument("Result shape does not match dot product");
+		}
+
+		if (!accumulate) {
+			for (int i = 0; i < rows; ++i) {
+				T* out = result.data[i].getData();
+				for (int j = 0; j < cols; ++j) {
+					out[j] = 0;
 				}
-				result({ i, j }) = sum;
 			}
 		}
 
-		return result;
+		if (transpose2) {
+			for (int i = 0; i < rows; ++i) {
+				const T* a = t1.data[i].getData();
+				T* out = result.data[i].getData();
+				for (int j = 0; j < cols; ++j) {
+					const T* b = t2.data[j].getData();
+					T sum = 0;
+					for (int k = 0; k < inner; ++k) {
+						sum += a[k] * b[k];
+					}
+					out[j] += sum;
+				}
+			}
+		}
+		else if (transpose1) {
+			for (int k = 0; k < inner; ++k) {
+				const T* a = t1.data[k].getData();
+				const T* b = t2.data[k].getData();
+				for (int i = 0; i < rows; ++i) {
+					const T aki = a[i];
+					T* out = result.data[i].getData();
+					for (int j = 0; j < cols; ++j) {
+						out[j] += aki * b[j];
+					}
+				}
+			}
+		}
+		else {
+			// i-k-j order: every inner loop streams one contiguous row of t2 into one row of the result
+			for (int i = 0; i < rows; ++i) {
+				const T* a = t1.data[i].getData();
+				T* out = result.data[i].getData();
+				for (int k = 0; k < inner; ++k) {
+					const T aik = a[k];
+					const T* b = t2.data[k].getData();
+					for (int j = 0; j < cols; ++j) {
+						out[j] += aik * b[j];
+					}
+				}
+			}
+		}
 	}
 
 	static Tensor2<T> transpose(const Tensor<T>& tensor) {
@@ -957,6 +1158,60 @@ public:
 		}
 	}
 
+	// Numerically stable softmax: an online max/sum pass followed by one normalizing pass
+	static Tensor2<T> softmax(const Tensor2<T>& tensor, int axis = 0) {
+		Tensor2<T> result(tensor.shape);
+		if (axis == 0) {
+			const int rows = tensor.shape[0];
+			const int cols = tensor.shape[1];
+			std::vector<T> maxVals(tensor.data[0].getData(), tensor.data[0].getData() + cols);
+			std::vector<T> sums(cols, 1);
+			for (int i = 1; i < rows; ++i) {
+				const T* row = tensor.data[i].getData();
+				for (int j = 0; j < cols; ++j) {
+					if (row[j] > maxVals[j]) {
+						sums[j] = sums[j] * std::exp(maxVals[j] - row[j]) + 1;
+						maxVals[j] = row[j];
+					}
+					else {
+						sums[j] += std::exp(row[j] - maxVals[j]);
+					}
+				}
+			}
+			for (int i = 0; i < rows; ++i) {
+				const T* row = tensor.data[i].getData();
+				T* out = result.data[i].getData();
+				for (int j = 0; j < cols; ++j) {
+					out[j] = std::exp(row[j] - maxVals[j]) / sums[j];
+				}
+			}
+			return result;
+		}
+		else if (axis == 1) {
+			for (int i = 0; i < tensor.shape[0]; ++i) {
+				const T* row = tensor.data[i].getData();
+				T* out = result.data[i].getData();
+				T maxVal = row[0];
+				for (int j = 1; j < tensor.shape[1]; ++j) {
+					maxVal = row[j] > maxVal ? row[j] : maxVal;
+				}
+				T sum = 0;
+				for (int j = 0; j < tensor.shape[1]; ++j) {
+					out[j] = std::exp(row[j] - maxVal);
+					sum += out[j];
+				}
+				for (int j = 0; j < tensor.shape[1]; ++j) {
+					out[j] /= sum;
+				}
+			}
+			return result;
+		}
+		else {
+			std::cerr << "Invalid axis\n";
+			throw std::invalid_argument("Invalid axis");
+		}
+	}
+
 	static Tensor2<T> log(const Tensor2<T>& tensor) {
 		Tensor2<T> result(tensor.shape);
 		for (int i = 0; i < tensor.shape[0]; ++i) {
@@ -1027,12 +1282,23 @@ public:
 
 	Tensor3(const Tensor3& other) : Tensor<T>(other.shape)
 	{
+		// Copying a default-constructed (empty) tensor yields another empty tensor
+		if (other.shape.empty()) {
+			return;
+		}
 		data = new Tensor2<T>[other.shape[0]];
 		for (int i = 0; i < other.shape[0]; ++i) {
 			data[i] = other.data[i];
 		}
 	}
 
+	Tensor3(Tensor3&& other) noexcept
+	{
+		this->shape = std::move(other.shape);
+		data = other.data;
+		other.data = nullptr;
+	}
+
 	~Tensor3() {
 		delete[] data;
 	}
@@ -1043,8 +1309,12 @@ public:
 		}
 
 		delete[] data;
+		data = nullptr;
 
 		this->shape = other.shape;
+		if (other.shape.empty()) {
+			return *this;
+		}
 		data = new Tensor2<T>[other.shape[0]];
 		for (int i = 0; i < other.shape[0]; ++i) {
 			data[i] = other.data[i];
@@ -1053,6 +1323,14 @@ public:
 		return *this;
 	}
 
+	Tensor3& operator=(Tensor3&& other) noexcept {
+		if (this != &other) {
+			std::swap(this->shape, other.shape);
+			std::swap(data, other.data);
+		}
+		return *this;
+	}
+
 	T& operator()(const std::vector<int>& indices) override {
 		return data[indices[0]]({ indices[1], indices[2] });
 	}
@@ -1068,6 +1346,14 @@ public:
 		data[indices[0]]({ indices[1], indices[2] }) = value;
 	}
 
+	Tensor2<T>& operator[] (int index) {
+		return data[index];
+	}
+
+	const Tensor2<T>& operator[] (int index) const {
+		return data[index];
+	}
+
 	Tensor3 operator+(const Tensor3& other) const {
 		if (this->shape != other.shape) {
 			throw std::invalid_argument("Dimensions must match for addition");
@@ -1181,13 +1467,30 @@ public:
 	}
 
 
+	// Batched matrix product: (B, M, K) . (B, K, N) -> (B, M, N). Either operand may have a batch
+	// of 1, which is broadcast, so shared weights can be stored as a (1, K, N) tensor.
 	static Tensor3<T> dot(const Tensor<T>& tensor1, const Tensor<T>& tensor2) {
-			// Implement dot product of two 3D tensors
-			const Tensor3<T>& t1 = dynamic_cast<const Tensor3<T>&>(tensor1);
-			const Tensor3<T>& t2 = dynamic_cast<const Tensor3<T>&>(tensor2);
-			throw std::logic_error("Function not yet implemented");
+		const Tensor3<T>& t1 = dynamic_cast<const Tensor3<T>&>(tensor1);
+		const Tensor3<T>& t2 = dynamic_cast<const Tensor3<T>&>(tensor2);
+
+		return dot(t1, t2, false, false);
+	}
+
+	static Tensor3<T> dot(const Tensor3<T>& t1, const Tensor3<T>& t2, bool transpose1, bool transpose2) {
+		if (t1.shape[0] != t2.shape[0] && t1.shape[0] != 1 && t2.shape[0] != 1) {
+			std::cerr << "Batch dimensions must match for dot product\n";
+			throw std::invalid_argument("Batch dimensions must match for dot product");
+		}
+
+		const int batch = t1.shape[0] > t2.shape[0] ? t1.shape[0] : t2.shape[0];
+		Tensor3<T> result({ batch, transpose1 ? t1.shape[2] : t1.shape[1], transpose2 ? t2.shape[1] : t2.shape[2] });
+		for (int b = 0; b < batch; ++b) {
+			Tensor2<T>::dotInto(t1.data[t1.shape[0] == 1 ? 0 : b], t2.data[t2.shape[0] == 1 ? 0 : b], result.data[b], transpose1, transpose2, true);
 		}
 
+		return result;
+	}
+
 private:
 	Tensor2<T>* data = nullptr;
 
@@ -0,0 +1,112 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <exception>
+#include <vector>
+
+// Fixed set of worker threads for indexed tasks. run() hands out task indices through an atomic
+// counter, the calling thread works on them too, and it returns once every task has finished.
+// Which thread runs a task never matters, so results depend only on the task index.
+class ThreadPool {
+public:
+    ThreadPool(int threads) : stopping(false), generation(0), active(0), taskCount(0), nextTask(0), current(nullptr) {
+        for (int i = 1; i < threads; ++i) {
+            workers.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const {
+        return static_cast<int>(workers.size()) + 1;
+    }
+
+    // Runs task(0) .. task(count - 1); the first exception thrown by a task is rethrown here
+    void run(int count, const std::function<void(int)>& task) {
+        if (count <= 0) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            current = &task;
+            taskCount = count;
+            nextTask = 0;
+            failure = nullptr;
+            active = static_cast<int>(workers.size());
+            generation++;
+        }
+        wake.notify_all();
+        drain();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return active == 0; });
+        current = nullptr;
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    bool stopping;
+    size_t generation;
+    int active;
+    int taskCount;
+    std::atomic<int> nextTask;
+    const std::function<void(int)>* current;
+    std::exception_ptr failure;
+
+    void drain() {
+        int index;
+        while ((index = nextTask.fetch_add(1)) < taskCount) {
+            try {
+                (*current)(index);
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!failure) {
+                    failure = std::current_exception();
+                }
+            }
+        }
+    }
+
+    void workerLoop() {
+        size_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) {
+                    return;
+                }
+                seen = generation;
+            }
+            drain();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--active == 0) {
+                    done.notify_one();
+                }
+            }
+        }
+    }
+};